@@ -0,0 +1,398 @@
+/*
+ * nim_bench: micro-benchmarks of the engine and the console's hot paths.
+ *
+ *   nim_bench [--filter <substring>] [--min-time <ms>] [--json]
+ *
+ * Reports ns/op, heap allocations/op and throughput for every benchmark
+ * whose name contains the filter, as a table or as one JSON document.
+ */
+
+// The console helpers (word_wrap_fill, NimConsole, ...) are internal
+// to Application.cc, so it is compiled right into the benchmark instead of
+// being exported just for this.
+#include "../src/Application.cc"
+#include <nim/Simd.h>
+#include <nim/nim_core.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <streambuf>
+
+// Every heap allocation of the process goes through here and is counted.
+// GCC flags the free() in the replacement deletes as mismatched with new.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static std::atomic<nim::uint64> g_allocations{ 0 };
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace nim
+{
+    namespace bench
+    {
+        // Keeps the compiler from optimizing a result away
+        template <typename T>
+        inline void Keep(const T& value)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            asm volatile("" : : "g"(&value) : "memory");
+#else
+            static volatile const void* sink;
+            sink = &value;
+#endif
+        }
+
+        // Swallows whatever the console prints while it is being measured
+        struct NullBuffer : public std::streambuf
+        {
+        protected:
+            virtual int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+            virtual std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+        };
+
+        struct Benchmark
+        {
+            string Name;
+            size_t BytesPerOp;      // input bytes consumed by one op, 0 if not meaningful
+            std::function<void(size_t)> Run;    // runs the given number of ops
+        };
+
+        struct Result
+        {
+            string Name;
+            uint64 Ops;
+            double NsPerOp;
+            double AllocsPerOp;
+            double OpsPerSec;
+            double BytesPerSec;
+        };
+
+        static Result Measure(const Benchmark& benchmark, double min_seconds)
+        {
+            using clock = std::chrono::steady_clock;
+
+            // warm up, then grow the batch until it runs long enough to time
+            benchmark.Run(1);
+            size_t ops = 1;
+            for (;;)
+            {
+                auto allocations = g_allocations.load(std::memory_order_relaxed);
+                auto start = clock::now();
+                benchmark.Run(ops);
+                auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+                allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+                if (seconds >= min_seconds || ops >= (size_t(1) << 40))
+                {
+                    Result result;
+                    result.Name = benchmark.Name;
+                    result.Ops = ops;
+                    result.NsPerOp = seconds * 1e9 / double(ops);
+                    result.AllocsPerOp = double(allocations) / double(ops);
+                    result.OpsPerSec = double(ops) / seconds;
+                    result.BytesPerSec = double(benchmark.BytesPerOp) * result.OpsPerSec;
+                    return result;
+                }
+                // aim a bit past the target so the next round usually is the last
+                auto scale = seconds > 0 ? 1.5 * min_seconds / seconds : 100.0;
+                ops = size_t(double(ops) * std::min(std::max(scale, 2.0), 100.0));
+            }
+        }
+
+        // CPU move plus its take on the engine alone; a finished game is
+        // re-randomized inside the timed loop
+        static Benchmark CPUMoveBenchmark(int32 pile_count)
+        {
+            auto game = std::make_shared<Game>(pile_count, uint64(pile_count));
+            return { "cpu_move/" + std::to_string(pile_count), 0, [game](size_t ops)
+            {
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    auto move = game->CPUMove();
+                    game->Take(move.Number, move.Pile);
+                    if (game->GameOver()) { game->Rnd(); }
+                }
+            } };
+        }
+
+        // The C API's move on 128-bit piles, BigUInt arithmetic throughout
+        static Benchmark PositionU128Benchmark(size_t pile_count)
+        {
+            auto counts = std::make_shared<vector<uint64>>(2 * pile_count);
+            Random random(pile_count);
+            for (auto& half : *counts)
+            {
+                half = random.Next();
+            }
+            return { "position_cpu_move/u128/" + std::to_string(pile_count), 0, [counts, pile_count](size_t ops)
+            {
+                uint64_t number[2];
+                int32_t pile;
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    Keep(nim_position_cpu_move_u128(counts->data(), pile_count, number, &pile));
+                }
+            } };
+        }
+
+        // The console's CPU turn: move, take, turn switch, prompt and piles
+        // printed (into a null stream)
+        static Benchmark CPUTurnBenchmark(int32 pile_count, detail::NimImpl& nimpl)
+        {
+            return { "cpu_turn/" + std::to_string(pile_count), 0, [&nimpl, pile_count](size_t ops)
+            {
+                if (nimpl.PileCount() != pile_count) { nimpl.Resize(pile_count); }
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    nimpl.CPUTurn();
+                    if (nimpl.GameOver()) { nimpl.Rnd(); }
+                }
+            } };
+        }
+
+        // A session snapshotted into a reused buffer, as a checkpoint would
+        static Benchmark SaveBenchmark(int32 pile_count, detail::NimImpl& nimpl)
+        {
+            return { "snapshot_save/" + std::to_string(pile_count), 0, [&nimpl, pile_count](size_t ops)
+            {
+                if (nimpl.PileCount() != pile_count) { nimpl.Resize(pile_count); }
+                string snapshot;
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    snapshot.clear();
+                    nimpl.Save(snapshot);
+                    Keep(snapshot);
+                }
+            } };
+        }
+
+        // The same snapshot restored over and over
+        static Benchmark LoadBenchmark(int32 pile_count, detail::NimImpl& nimpl)
+        {
+            return { "snapshot_load/" + std::to_string(pile_count), 0, [&nimpl, pile_count](size_t ops)
+            {
+                if (nimpl.PileCount() != pile_count) { nimpl.Resize(pile_count); }
+                string snapshot;
+                nimpl.Save(snapshot);
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    Keep(nimpl.Load(snapshot.data(), snapshot.size()));
+                }
+            } };
+        }
+
+        static Benchmark TriggerBenchmark(const string& name, const string& command, detail::NimConsole& console, detail::NimImpl& nimpl)
+        {
+            return { "trigger/" + name, command.size(), [&console, &nimpl, command](size_t ops)
+            {
+                // big piles, so repeated takes never end the game
+                const int32 piles[] = { 1 << 30, 1 << 30, 1 << 30 };
+                nimpl.SetPiles(piles, 3);
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    console.trigger(command);
+                }
+            } };
+        }
+
+        template <typename F>
+        static Benchmark ParseBenchmark(const string& name, const char* input, F parse)
+        {
+            return { name, std::strlen(input), [input, parse](size_t ops)
+            {
+                for (size_t i = 0; i < ops; ++i)
+                {
+                    Keep(parse(input));
+                }
+            } };
+        }
+
+        static void PrintTable(const vector<Result>& results)
+        {
+            std::printf("%-28s %12s %12s %12s %14s %12s\n", "benchmark", "ops", "ns/op", "allocs/op", "ops/s", "MB/s");
+            for (const auto& r : results)
+            {
+                std::printf("%-28s %12llu %12.2f %12.2f %14.0f", r.Name.c_str(), (unsigned long long)r.Ops, r.NsPerOp, r.AllocsPerOp, r.OpsPerSec);
+                if (r.BytesPerSec > 0)
+                {
+                    std::printf(" %12.2f\n", r.BytesPerSec / 1e6);
+                }
+                else
+                {
+                    std::printf(" %12s\n", "-");
+                }
+            }
+        }
+
+        static void PrintJson(const vector<Result>& results)
+        {
+            std::printf("{\n  \"simd_isa\": \"%s\",\n  \"benchmarks\": [", simd::IsaName(simd::ActiveIsa()));
+            for (size_t i = 0; i < results.size(); ++i)
+            {
+                const auto& r = results[i];
+                std::printf("%s\n    { \"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f, \"ops_per_sec\": %.1f, \"bytes_per_sec\": %.1f }",
+                    i ? "," : "", r.Name.c_str(), (unsigned long long)r.Ops, r.NsPerOp, r.AllocsPerOp, r.OpsPerSec, r.BytesPerSec);
+            }
+            std::printf("\n  ]\n}\n");
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace nim;
+    using namespace nim::bench;
+    using namespace numerics;
+
+    string filter;
+    double min_seconds = 0.25;
+    bool json = false;
+    for (auto i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        auto has_value = (i + 1 < argc);
+        if (arg == "--filter" && has_value)
+        {
+            filter = argv[++i];
+        }
+        else if (arg == "--min-time" && has_value)
+        {
+            int32 ms;
+            if (!parse_integral<int32>(argv[++i], &ms) || ms < 1)
+            {
+                std::fprintf(stderr, "Expected --min-time <ms> with <ms> of at least 1.\n");
+                return 1;
+            }
+            min_seconds = ms / 1000.0;
+        }
+        else if (arg == "--json")
+        {
+            json = true;
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <ms>] [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    detail::WordWrapSetUp();
+
+    detail::NimImpl nimpl;
+    detail::NimConsole console(&nimpl);
+    nimpl.Console = &console;
+    nimpl.Player1Name = "player1";
+    nimpl.Player2Name = "player2";
+    nimpl.CPUName = "cpu";
+    nimpl.CPU = false;
+    nimpl.Quit = false;
+    nimpl.Seed(1);
+
+    const string help_text =
+        "Take <number> of chips (in range [1, pile length]) from <pile>-th pile (in range [1, number of piles]).";
+
+    vector<Benchmark> benchmarks = {
+        CPUMoveBenchmark(3),
+        CPUMoveBenchmark(1000),
+        PositionU128Benchmark(1000),
+        CPUTurnBenchmark(3, nimpl),
+        CPUTurnBenchmark(1000, nimpl),
+        SaveBenchmark(3, nimpl),
+        SaveBenchmark(1000, nimpl),
+        LoadBenchmark(3, nimpl),
+        LoadBenchmark(1000, nimpl),
+        ParseBenchmark("parse_integral/int32", "123456789", [](const char* s) { int32 v = 0; parse_integral<int32>(s, &v); return v; }),
+        ParseBenchmark("parse_integral/int64", "-9223372036854775807", [](const char* s) { int64 v = 0; parse_integral<int64>(s, &v); return v; }),
+        ParseBenchmark("from_chars/uint64", "18446744073709551615", [](const char* s) { uint64 v = 0; from_chars(s, s + 20, v); return v; }),
+        ParseBenchmark("parse_hex/int32", "0x7fA3c9e1", [](const char* s) { int32 v = 0; parse_hex<int32>(s, &v); return v; }),
+        ParseBenchmark("parse_fp/double", "-31415.9265e-4", [](const char* s) { double v = 0; parse_fp<double>(s, &v); return v; }),
+        ParseBenchmark("parse_fp/double-17-digits", "2.2250738585072014e-308", [](const char* s) { double v = 0; parse_fp<double>(s, &v); return v; }),
+        { "tokenize/command", 13, [](size_t ops)
+        {
+            const string command = "take 5 from 2";
+            detail::Args parts;
+            for (size_t i = 0; i < ops; ++i)
+            {
+                detail::Tokenize(command, parts);
+                Keep(parts);
+            }
+        } },
+        { "word_wrap_fill/help", help_text.size(), [&help_text](size_t ops)
+        {
+            for (size_t i = 0; i < ops; ++i)
+            {
+                Keep(detail::word_wrap_fill(help_text, DESCRIPTION_WIDTH));
+            }
+        } },
+        TriggerBenchmark("take", "take 1 from 2", console, nimpl),
+        TriggerBenchmark("number", "1 2", console, nimpl),
+        TriggerBenchmark("show", "show", console, nimpl),
+        TriggerBenchmark("help", "help take", console, nimpl),
+        TriggerBenchmark("unknown", "xyzzy", console, nimpl)
+    };
+
+    vector<Result> results;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (benchmark.Name.find(filter) == string::npos) { continue; }
+
+        // the console writes to cout; time it without the terminal
+        NullBuffer null_buffer;
+        auto old_buffer = cout.rdbuf(&null_buffer);
+        auto result = Measure(benchmark, min_seconds);
+        cout.rdbuf(old_buffer);
+
+        results.push_back(result);
+        if (!json)
+        {
+            std::fprintf(stderr, "  %s done\n", benchmark.Name.c_str());
+        }
+    }
+
+    if (json)
+    {
+        PrintJson(results);
+    }
+    else
+    {
+        PrintTable(results);
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * nim_shm_client: reference client of the shared-memory channel.
+ *
+ *   nim --shm <name> &
+ *   nim_shm_client <name> [--games <count>] [--piles <count>]
+ *
+ * Plays the given number of games against the engine's CPU, choosing its
+ * own moves by the nim-sum, then reports its wins and the round-trip
+ * latency of a move (the request written until the reply is read).
+ */
+
+#include "../src/shm.hpp"
+#include "../src/parse.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace nim
+{
+    namespace client
+    {
+        using namespace detail;
+
+        // The winning move on reply's piles if there is one, otherwise a
+        // single chip from the biggest pile; piles count from 1
+        static void ChooseMove(const ShmReply& reply, int32& pile, int32& count)
+        {
+            auto nim_sum = 0;
+            auto biggest = 0;
+            for (auto i = 0; i < reply.PileCount; ++i)
+            {
+                nim_sum ^= reply.Piles[i];
+                if (reply.Piles[i] > reply.Piles[biggest]) { biggest = i; }
+            }
+            for (auto i = 0; nim_sum != 0 && i < reply.PileCount; ++i)
+            {
+                auto target = reply.Piles[i] ^ nim_sum;
+                if (target < reply.Piles[i])
+                {
+                    pile = i + 1;
+                    count = reply.Piles[i] - target;
+                    return;
+                }
+            }
+            pile = biggest + 1;
+            count = 1;
+        }
+
+        static double Percentile(std::vector<double>& samples, double fraction)
+        {
+            auto at = size_t(fraction * double(samples.size() - 1));
+            std::nth_element(samples.begin(), samples.begin() + std::ptrdiff_t(at), samples.end());
+            return samples[at];
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace nim;
+    using namespace nim::detail;
+    using namespace nim::client;
+    using clock = std::chrono::steady_clock;
+
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <name> [--games <count>] [--piles <count>]\n", argv[0]);
+        return 1;
+    }
+    std::string name = argv[1];
+    int32 games = 10000;
+    int32 piles = 0;
+    for (auto i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto has_value = (i + 1 < argc);
+        if (arg == "--games" && has_value)
+        {
+            if (!numerics::parse_integral<int32>(argv[++i], &games) || games < 1)
+            {
+                std::fprintf(stderr, "Expected --games <count> with <count> of at least 1.\n");
+                return 1;
+            }
+        }
+        else if (arg == "--piles" && has_value)
+        {
+            if (!numerics::parse_integral<int32>(argv[++i], &piles) || piles < 1 || piles > SHM_MAX_PILES)
+            {
+                std::fprintf(stderr, "Expected --piles <count> with <count> in range [1, %d].\n", int(SHM_MAX_PILES));
+                return 1;
+            }
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s <name> [--games <count>] [--piles <count>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ShmChannel channel;
+    if (!channel.Open(name))
+    {
+        std::fprintf(stderr, "Could not open %s: %s.\n", ShmChannel::PathOf(name).c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    std::vector<double> samples;
+    uint32 id = 0;
+    int32 wins = 0;
+    ShmRequest request;
+    ShmReply reply;
+    auto start = clock::now();
+    for (auto game = 0; game < games; ++game)
+    {
+        request.Id = ++id;
+        request.Op = SHM_RESTART;
+        request.Pile = SHM_CPU;
+        request.Count = piles;
+        if (!channel.Send(request) || !channel.Receive(reply)) { break; }
+        while (!reply.Over)
+        {
+            request.Id = ++id;
+            request.Op = SHM_MOVE;
+            ChooseMove(reply, request.Pile, request.Count);
+            auto sent = clock::now();
+            if (!channel.Send(request) || !channel.Receive(reply))
+            {
+                std::fprintf(stderr, "The engine has gone away.\n");
+                return 1;
+            }
+            samples.push_back(std::chrono::duration<double, std::micro>(clock::now() - sent).count());
+            if (reply.Status != SHM_OK || reply.Id != request.Id)
+            {
+                std::fprintf(stderr, "Move %u refused (status %u).\n", unsigned(request.Id), unsigned(reply.Status));
+                return 1;
+            }
+        }
+        if (reply.Winner == 1) { ++wins; }
+    }
+    auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    request.Id = ++id;
+    request.Op = SHM_CLOSE;
+    if (channel.Send(request)) { channel.Receive(reply); }
+
+    if (samples.empty()) { return 1; }
+    auto mean = 0.0;
+    for (auto sample : samples) { mean += sample; }
+    mean /= double(samples.size());
+    std::printf("  Games:             %d (%d won)\n", games, wins);
+    std::printf("  Moves:             %zu in %.3f s\n", samples.size(), seconds);
+    std::printf("  Round trip:        %.2f us mean, %.2f us p50, %.2f us p99\n",
+        mean, Percentile(samples, 0.5), Percentile(samples, 0.99));
+    return 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Export.h"
+#include "ThreadPool.h"
+#include <cstddef>
+
+namespace nim
+{
+    // Many positions packed back to back in one buffer of pile counts.
+    // Position i is either Counts[Offsets[i], Offsets[i + 1]) or, without
+    // Offsets, PileCount piles starting at Counts[i * PileCount].
+    template <typename T>
+    struct BatchInput
+    {
+        const T* Counts;
+        const size_t* Offsets;      // PositionCount + 1 entries, or null
+        size_t PileCount;           // piles per position when Offsets is null
+        size_t PositionCount;
+    };
+
+    // Caller-owned result arrays, one entry per position unless noted. Any
+    // of them may be null to skip that part of the analysis.
+    template <typename T>
+    struct BatchOutput
+    {
+        uint8* Winning;             // 1 for an N-position (player to move wins), 0 for a P-position
+        T* NimSums;
+        T* MoveNumbers;             // first winning move, 0 for a P-position
+        int32* MovePiles;           // its pile index within the position, -1 for a P-position
+
+        // Every winning move. These two are laid out like BatchInput::Counts:
+        // the moves of position i start at its first pile's offset.
+        int32* WinningPiles;
+        T* WinningNumbers;
+        size_t* WinningCounts;      // number of winning moves of each position
+    };
+
+    // Analyzes every position of input into output. Spread over pool when
+    // one is given (batches smaller than a few thousand positions are not
+    // worth it), otherwise on the calling thread. Allocates nothing.
+    NIM_API void AnalyzeBatch(const BatchInput<uint32>& input, const BatchOutput<uint32>& output, ThreadPool* pool = nullptr);
+    NIM_API void AnalyzeBatch(const BatchInput<uint64>& input, const BatchOutput<uint64>& output, ThreadPool* pool = nullptr);
+}
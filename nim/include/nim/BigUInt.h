@@ -0,0 +1,130 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "Bits.h"
+#include <cstddef>
+
+namespace nim
+{
+    // Fixed-width unsigned integer of LIMBS 64-bit limbs (least significant
+    // first), for pile counts of 2^64 and beyond. The width is fixed per
+    // type so positions of BigUInt piles stay one contiguous array.
+    template <size_t LIMBS>
+    struct BigUInt
+    {
+        static_assert(LIMBS > 0, "BigUInt needs at least one limb");
+
+        uint64 Limbs[LIMBS];
+
+        BigUInt()
+        {
+            for (auto& limb : Limbs) { limb = 0; }
+        }
+
+        BigUInt(uint64 low)
+        {
+            Limbs[0] = low;
+            for (size_t i = 1; i < LIMBS; ++i) { Limbs[i] = 0; }
+        }
+
+        BigUInt& operator ^=(const BigUInt& other)
+        {
+            for (size_t i = 0; i < LIMBS; ++i) { Limbs[i] ^= other.Limbs[i]; }
+            return *this;
+        }
+
+        BigUInt& operator |=(const BigUInt& other)
+        {
+            for (size_t i = 0; i < LIMBS; ++i) { Limbs[i] |= other.Limbs[i]; }
+            return *this;
+        }
+
+        BigUInt& operator &=(const BigUInt& other)
+        {
+            for (size_t i = 0; i < LIMBS; ++i) { Limbs[i] &= other.Limbs[i]; }
+            return *this;
+        }
+
+        BigUInt& operator +=(const BigUInt& other)
+        {
+            uint64 carry = 0;
+            for (size_t i = 0; i < LIMBS; ++i)
+            {
+                auto sum = Limbs[i] + other.Limbs[i];
+                auto next = uint64(sum < Limbs[i]);
+                Limbs[i] = sum + carry;
+                carry = next | uint64(Limbs[i] < sum);
+            }
+            return *this;
+        }
+
+        BigUInt& operator -=(const BigUInt& other)
+        {
+            uint64 borrow = 0;
+            for (size_t i = 0; i < LIMBS; ++i)
+            {
+                auto diff = Limbs[i] - other.Limbs[i];
+                auto next = uint64(Limbs[i] < other.Limbs[i]);
+                Limbs[i] = diff - borrow;
+                borrow = next | uint64(diff < borrow);
+            }
+            return *this;
+        }
+
+        friend BigUInt operator ^(BigUInt a, const BigUInt& b) { return a ^= b; }
+        friend BigUInt operator |(BigUInt a, const BigUInt& b) { return a |= b; }
+        friend BigUInt operator &(BigUInt a, const BigUInt& b) { return a &= b; }
+        friend BigUInt operator +(BigUInt a, const BigUInt& b) { return a += b; }
+        friend BigUInt operator -(BigUInt a, const BigUInt& b) { return a -= b; }
+
+        friend bool operator ==(const BigUInt& a, const BigUInt& b)
+        {
+            uint64 diff = 0;
+            for (size_t i = 0; i < LIMBS; ++i) { diff |= a.Limbs[i] ^ b.Limbs[i]; }
+            return diff == 0;
+        }
+
+        friend bool operator !=(const BigUInt& a, const BigUInt& b) { return !(a == b); }
+
+        friend bool operator <(const BigUInt& a, const BigUInt& b)
+        {
+            for (size_t i = LIMBS; i-- > 0;)
+            {
+                if (a.Limbs[i] != b.Limbs[i]) { return a.Limbs[i] < b.Limbs[i]; }
+            }
+            return false;
+        }
+
+        friend bool operator >(const BigUInt& a, const BigUInt& b) { return b < a; }
+        friend bool operator <=(const BigUInt& a, const BigUInt& b) { return !(b < a); }
+        friend bool operator >=(const BigUInt& a, const BigUInt& b) { return !(a < b); }
+    };
+
+    template <size_t LIMBS>
+    bool IsZero(const BigUInt<LIMBS>& v)
+    {
+        uint64 any = 0;
+        for (size_t i = 0; i < LIMBS; ++i) { any |= v.Limbs[i]; }
+        return any == 0;
+    }
+
+    // clz on the most significant nonzero limb
+    template <size_t LIMBS>
+    unsigned HighestBitIndex(const BigUInt<LIMBS>& v)
+    {
+        for (size_t i = LIMBS; i-- > 1;)
+        {
+            if (v.Limbs[i]) { return unsigned(i * 64) + HighestBitIndex(v.Limbs[i]); }
+        }
+        return HighestBitIndex(v.Limbs[0]);
+    }
+
+    template <size_t LIMBS>
+    uint64 BitOf(const BigUInt<LIMBS>& v, unsigned bit)
+    {
+        return v.Limbs[bit / 64] & (uint64(1) << (bit % 64));
+    }
+
+    using UInt128 = BigUInt<2>;
+    using UInt256 = BigUInt<4>;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Assert.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Bit helpers for pile counts. Every count type (built-in integers here,
+// BigUInt in BigUInt.h) provides the same overloads so the algorithms in
+// Position.h are written once.
+
+namespace nim
+{
+    // Index of the highest set bit of v (v != 0), via count-leading-zeros
+    inline unsigned HighestBitIndex(uint32 v)
+    {
+        NIM_ASSERT(v != 0);
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse(&index, v);
+        return unsigned(index);
+#else
+        return 31u - unsigned(__builtin_clz(v));
+#endif
+    }
+
+    inline unsigned HighestBitIndex(uint64 v)
+    {
+        NIM_ASSERT(v != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+        unsigned long index;
+        _BitScanReverse64(&index, v);
+        return unsigned(index);
+#elif defined(_MSC_VER)
+        auto high = uint32(v >> 32);
+        return high ? 32u + HighestBitIndex(high) : HighestBitIndex(uint32(v));
+#else
+        return 63u - unsigned(__builtin_clzll(v));
+#endif
+    }
+
+    // Index of the lowest set bit of v (v != 0), via count-trailing-zeros
+    inline unsigned LowestBitIndex(uint32 v)
+    {
+        NIM_ASSERT(v != 0);
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, v);
+        return unsigned(index);
+#else
+        return unsigned(__builtin_ctz(v));
+#endif
+    }
+
+    inline unsigned LowestBitIndex(uint64 v)
+    {
+        NIM_ASSERT(v != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+        unsigned long index;
+        _BitScanForward64(&index, v);
+        return unsigned(index);
+#elif defined(_MSC_VER)
+        auto low = uint32(v);
+        return low ? LowestBitIndex(low) : 32u + LowestBitIndex(uint32(v >> 32));
+#else
+        return unsigned(__builtin_ctzll(v));
+#endif
+    }
+
+    inline unsigned HighestBitIndex(int32 v)
+    {
+        NIM_ASSERT(v > 0);
+        return HighestBitIndex(uint32(v));
+    }
+
+    inline unsigned HighestBitIndex(int64 v)
+    {
+        NIM_ASSERT(v > 0);
+        return HighestBitIndex(uint64(v));
+    }
+
+    // Nonzero iff bit `bit` of v is set. The result type is what gets OR'd
+    // across a block of piles, so it stays a plain machine word.
+    inline uint32 BitOf(uint32 v, unsigned bit) { return v & (uint32(1) << bit); }
+    inline uint64 BitOf(uint64 v, unsigned bit) { return v & (uint64(1) << bit); }
+    inline uint32 BitOf(int32 v, unsigned bit) { return uint32(v) & (uint32(1) << bit); }
+    inline uint64 BitOf(int64 v, unsigned bit) { return uint64(v) & (uint64(1) << bit); }
+
+    inline bool IsZero(uint32 v) { return v == 0; }
+    inline bool IsZero(uint64 v) { return v == 0; }
+    inline bool IsZero(int32 v) { return v == 0; }
+    inline bool IsZero(int64 v) { return v == 0; }
+}
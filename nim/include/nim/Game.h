@@ -0,0 +1,70 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Export.h"
+#include "Pile.h"
+#include "Position.h"
+#include "NimIndex.h"
+#include "Random.h"
+
+namespace nim
+{
+    // Outcome of validating or applying a move
+    enum class TakeResult
+    {
+        Ok,
+        PileRange,      // pile index outside [0, PileCount())
+        PileEmpty,      // the pile has no chips left
+        NumberRange     // number outside [1, pile length]
+    };
+
+    // Headless game state and rules. Performs no I/O, so it can be embedded
+    // directly; the console front-end only formats what happens here.
+    class NIM_API Game
+    {
+    public:
+        // Default pile count of the classic game
+        static const int32 PILE_COUNT = 3;
+
+        // Seeded from EntropySeed() unless a seed is given
+        explicit Game(int32 pile_count = PILE_COUNT);
+        Game(int32 pile_count, uint64 seed);
+
+        // Restarts the game's random sequence; Rnd and DecideTurn draw from it
+        void Seed(uint64 seed, uint64 stream = 0);
+        Random& GetRandom();
+
+        // Changes the number of piles and re-randomizes all of them
+        void Resize(int32 pile_count);
+        void Rnd();
+        void DecideTurn();
+        void SwitchTurn();
+
+        int32 PileCount() const;
+        const Pile& GetPile(int32 index) const;
+        const Position& GetPosition() const;
+        TakeResult SetPile(int32 index, int32 count);
+        // Replaces the whole position, resizing it to pile_count piles
+        TakeResult SetPiles(const int32* counts, int32 pile_count);
+
+        TakeResult CheckTake(int32 number, int32 pile) const;
+        TakeResult Take(int32 number, int32 pile);
+
+        // Winning move if there is one, otherwise a single chip from one of
+        // the biggest piles. Only meaningful while !GameOver(). These three
+        // are answered from the NimIndex in O(bits), not O(piles).
+        Move CPUMove() const;
+        int32 NimSum() const;
+        bool GameOver() const;
+
+        bool Player1Turn;
+        bool CPU;
+
+    private:
+        void Reindex();
+
+        Position Piles;
+        NimIndex Index;
+        Random Rng;
+    };
+}
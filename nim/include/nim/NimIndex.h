@@ -0,0 +1,148 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Assert.h"
+#include "Bits.h"
+#include "Pile.h"
+#include "Position.h"
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace nim
+{
+    // Running summary of a position: its nim-sum, how many piles are not
+    // empty and, for every bit, how many piles have it set plus a list of
+    // candidate piles that may have it. Keeping it current costs O(changed
+    // bits) per move, and in exchange the nim-sum, game over and the CPU
+    // move no longer need a pass over all piles.
+    template <typename T>
+    class BasicNimIndex
+    {
+        static_assert(std::is_integral<T>::value, "BasicNimIndex needs a built-in integer count type");
+
+        using Bits = typename std::make_unsigned<T>::type;
+
+    public:
+        static const unsigned BITS = sizeof(T) * 8;
+
+        BasicNimIndex()
+        {
+            Clear();
+        }
+
+        void Rebuild(const BasicPile<T>* piles, size_t count)
+        {
+            Clear();
+            for (size_t i = 0; i < count; ++i)
+            {
+                Update(piles, i, T(0));
+            }
+        }
+
+        // Records that piles[index] (already updated) used to hold old_count
+        void Update(const BasicPile<T>* piles, size_t index, T old_count)
+        {
+            const T& new_count = piles[index].Count();
+            auto changed = Bits(old_count) ^ Bits(new_count);
+            sum ^= T(changed);
+            non_empty += size_t(new_count != 0) - size_t(old_count != 0);
+            while (changed)
+            {
+                auto bit = LowestBitIndex(changed);
+                changed &= changed - 1;
+                if (BitOf(new_count, bit))
+                {
+                    ++bit_counts[bit];
+                    Push(piles, bit, index);
+                }
+                else
+                {
+                    // the pile's entry in candidates[bit] goes stale; stale
+                    // entries at the back are dropped right away, so the
+                    // last candidate is always live, and the rest when Push
+                    // compacts
+                    --bit_counts[bit];
+                    auto& list = candidates[bit];
+                    while (!list.empty() && !BitOf(piles[list.back()].Count(), bit))
+                    {
+                        list.pop_back();
+                    }
+                }
+            }
+        }
+
+        T NimSum() const { return sum; }
+        bool AllEmpty() const { return non_empty == 0; }
+        size_t NonEmptyCount() const { return non_empty; }
+        size_t BitCount(unsigned bit) const { return bit_counts[bit]; }
+
+        // Some pile that has `bit` set; BitCount(bit) must be nonzero. O(1):
+        // Update keeps the last candidate live.
+        size_t PileWithBit(const BasicPile<T>* piles, unsigned bit) const
+        {
+            NIM_ASSERT(bit_counts[bit] != 0);
+            const auto& list = candidates[bit];
+            NIM_ASSERT(BitOf(piles[list.back()].Count(), bit));
+            return list.back();
+        }
+
+        // Winning move if there is one, otherwise a single chip from one of
+        // the piles with the most significant bit. Only meaningful while
+        // !AllEmpty(). Reads the index only, so concurrent calls are safe.
+        BasicMove<T> CPUMove(const BasicPile<T>* piles) const
+        {
+            if (sum != 0)
+            {
+                // leaving (pile ^ sum) chips zeroes the nim-sum
+                auto index = PileWithBit(piles, HighestBitIndex(sum));
+                const T& pile = piles[index].Count();
+                return { T(pile - (pile ^ sum)), int32(index) };
+            }
+
+            // no good moves, take 1 from a biggest pile
+            for (auto bit = BITS; bit-- > 0;)
+            {
+                if (bit_counts[bit])
+                {
+                    return { T(1), int32(PileWithBit(piles, bit)) };
+                }
+            }
+            return { T(1), 0 };
+        }
+
+    private:
+        void Clear()
+        {
+            sum = T(0);
+            non_empty = 0;
+            for (unsigned bit = 0; bit < BITS; ++bit)
+            {
+                bit_counts[bit] = 0;
+                candidates[bit].clear();
+            }
+        }
+
+        void Push(const BasicPile<T>* piles, unsigned bit, size_t index)
+        {
+            auto& list = candidates[bit];
+            list.push_back(uint32(index));
+            // entries only go stale or duplicate when bits flip back and
+            // forth; compact once they outnumber the live ones
+            if (list.size() > 2 * bit_counts[bit] + 32)
+            {
+                std::sort(list.begin(), list.end());
+                list.erase(std::unique(list.begin(), list.end()), list.end());
+                list.erase(std::remove_if(list.begin(), list.end(), [piles, bit](uint32 i) { return !BitOf(piles[i].Count(), bit); }), list.end());
+            }
+        }
+
+        T sum;
+        size_t non_empty;
+        size_t bit_counts[BITS];
+        std::vector<uint32> candidates[BITS];
+    };
+
+    using NimIndex = BasicNimIndex<int32>;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Assert.h"
+#include "Bits.h"
+#include "Random.h"
+
+// Range of randomly generated piles
+#define NIM_PILE_MAX 20
+#define NIM_PILE_MIN 10
+
+namespace nim
+{
+    // Chip count of one pile, of any count type T (int32, uint32, uint64 or
+    // BigUInt<LIMBS>). Holds nothing but the count and is defined inline, so
+    // an array of piles is laid out and optimized like a plain T array.
+    template <typename T>
+    struct BasicPile
+    {
+        using CountType = T;
+
+        BasicPile& operator =(const T& new_count)
+        {
+            NIM_ASSERT(!(new_count < T(0)));
+            count = new_count;
+            return *this;
+        }
+
+        BasicPile& operator =(const BasicPile& other) = default;
+
+        BasicPile& operator --()
+        {
+            NIM_ASSERT(!IsZero(count));
+            count -= T(1);
+            return *this;
+        }
+
+        BasicPile& operator ++()
+        {
+            count += T(1);
+            return *this;
+        }
+
+        BasicPile operator --(int32)
+        {
+            BasicPile p{ count };
+            --*this;
+            return p;
+        }
+
+        BasicPile operator ++(int32)
+        {
+            BasicPile p{ count };
+            ++*this;
+            return p;
+        }
+
+        BasicPile& operator -=(const T& diff)
+        {
+            NIM_ASSERT(!(count < diff));
+            count -= diff;
+            return *this;
+        }
+
+        BasicPile& operator -=(const BasicPile& other)
+        {
+            return *this -= other.count;
+        }
+
+        BasicPile& operator +=(const T& diff)
+        {
+            count += diff;
+            return *this;
+        }
+
+        BasicPile& operator +=(const BasicPile& other)
+        {
+            return *this += other.count;
+        }
+
+        bool operator ==(const T& other_count) const
+        {
+            return count == other_count;
+        }
+
+        bool operator ==(const BasicPile& other) const
+        {
+            return count == other.count;
+        }
+
+        // Random count in [NIM_PILE_MIN, NIM_PILE_MAX)
+        void Rnd(Random& random)
+        {
+            count = T(NIM_PILE_MIN + static_cast<int>(random.Below(NIM_PILE_MAX - NIM_PILE_MIN)));
+        }
+
+        const T& Count() const
+        {
+            return count;
+        }
+
+        operator const T&() const
+        {
+            return count;
+        }
+
+        BasicPile() : count(0) {}
+        BasicPile(const T& new_count) : count(new_count)
+        {
+            NIM_ASSERT(!(new_count < T(0)));
+        }
+        BasicPile(const BasicPile& other) = default;
+
+    private:
+        T count;
+    };
+
+    using Pile = BasicPile<int32>;
+    using Pile32 = BasicPile<uint32>;
+    using Pile64 = BasicPile<uint64>;
+
+    // Count type of an element of a pile array: algorithms accept arrays of
+    // BasicPile<T> as well as raw arrays of T
+    template <typename E>
+    struct CountTypeOf
+    {
+        using type = E;
+    };
+
+    template <typename T>
+    struct CountTypeOf<BasicPile<T>>
+    {
+        using type = T;
+    };
+
+    template <typename T>
+    const T& CountOf(const T& count)
+    {
+        return count;
+    }
+
+    template <typename T>
+    const T& CountOf(const BasicPile<T>& pile)
+    {
+        return pile.Count();
+    }
+}
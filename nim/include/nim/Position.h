@@ -0,0 +1,267 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Assert.h"
+#include "Bits.h"
+#include "BigUInt.h"
+#include "Pile.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Alignment of run-time sized pile arrays (one cache line)
+#define NIM_PILE_ALIGNMENT 64
+
+namespace nim
+{
+    namespace detail
+    {
+        inline void* AlignedAlloc(size_t bytes)
+        {
+            // over-allocate and stash the original pointer right before the
+            // aligned block so AlignedFree can recover it
+            auto raw = static_cast<char*>(std::malloc(bytes + NIM_PILE_ALIGNMENT + sizeof(void*)));
+            if (!raw) { throw std::bad_alloc(); }
+            auto start = reinterpret_cast<uintptr_t>(raw + sizeof(void*));
+            auto aligned = (start + NIM_PILE_ALIGNMENT - 1) & ~uintptr_t(NIM_PILE_ALIGNMENT - 1);
+            reinterpret_cast<void**>(aligned)[-1] = raw;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        inline void AlignedFree(void* p)
+        {
+            if (p) { std::free(static_cast<void**>(p)[-1]); }
+        }
+
+        // Piles are stored as one contiguous array of counts (structure of
+        // arrays), so whole-position passes are plain loops over counts.
+        template <typename T>
+        struct PileStorage
+        {
+            PileStorage() : Piles(nullptr), Count(0) {}
+
+            explicit PileStorage(size_t count) : PileStorage()
+            {
+                Resize(count);
+            }
+
+            PileStorage(const PileStorage& other) : PileStorage()
+            {
+                *this = other;
+            }
+
+            PileStorage(PileStorage&& other) : Piles(other.Piles), Count(other.Count)
+            {
+                other.Piles = nullptr;
+                other.Count = 0;
+            }
+
+            ~PileStorage()
+            {
+                AlignedFree(Piles);
+            }
+
+            PileStorage& operator =(const PileStorage& other)
+            {
+                if (this != &other)
+                {
+                    Resize(other.Count);
+                    if (Count) { std::memcpy(static_cast<void*>(Piles), other.Piles, Count * sizeof(BasicPile<T>)); }
+                }
+                return *this;
+            }
+
+            PileStorage& operator =(PileStorage&& other)
+            {
+                std::swap(Piles, other.Piles);
+                std::swap(Count, other.Count);
+                return *this;
+            }
+
+            // Discards the current piles; the new ones are all empty
+            void Resize(size_t count)
+            {
+                if (count != Count)
+                {
+                    AlignedFree(Piles);
+                    Piles = nullptr;
+                    Count = 0;
+                    if (count)
+                    {
+                        Piles = static_cast<BasicPile<T>*>(AlignedAlloc(count * sizeof(BasicPile<T>)));
+                        Count = count;
+                    }
+                }
+                for (size_t i = 0; i < Count; ++i)
+                {
+                    new (&Piles[i]) BasicPile<T>();
+                }
+            }
+
+            BasicPile<T>* Data() { return Piles; }
+            const BasicPile<T>* Data() const { return Piles; }
+            size_t Size() const { return Count; }
+
+        private:
+            BasicPile<T>* Piles;
+            size_t Count;
+        };
+    }
+
+    // A NIM position: piles of count type T stored contiguously, as many as
+    // chosen at run time.
+    template <typename T>
+    class BasicPosition
+    {
+    public:
+        using PileType = BasicPile<T>;
+
+        BasicPosition() = default;
+
+        explicit BasicPosition(size_t count)
+        {
+            Resize(count);
+        }
+
+        // Changes the number of piles and empties every one of them
+        void Resize(size_t count)
+        {
+            storage.Resize(count);
+        }
+
+        size_t PileCount() const { return storage.Size(); }
+        PileType* Data() { return storage.Data(); }
+        const PileType* Data() const { return storage.Data(); }
+
+        PileType& operator [](size_t index)
+        {
+            NIM_ASSERT(index < PileCount());
+            return Data()[index];
+        }
+
+        const PileType& operator [](size_t index) const
+        {
+            NIM_ASSERT(index < PileCount());
+            return Data()[index];
+        }
+
+    private:
+        detail::PileStorage<T> storage;
+    };
+
+    using Position = BasicPosition<int32>;
+    using Position64 = BasicPosition<uint64>;
+
+    template <typename T>
+    struct BasicMove
+    {
+        T Number;       // chips to take
+        int32 Pile;     // zero-based pile index
+    };
+
+    using Move = BasicMove<int32>;
+
+    // Algorithms, written as single forward passes without early exits in
+    // the inner loops so they auto-vectorize for large pile counts. E is
+    // either BasicPile<T> or a raw count type T.
+
+    template <typename E>
+    typename CountTypeOf<E>::type NimSum(const E* piles, size_t count)
+    {
+        typename CountTypeOf<E>::type sum(0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            sum ^= CountOf(piles[i]);
+        }
+        return sum;
+    }
+
+    template <typename E>
+    bool AllEmpty(const E* piles, size_t count)
+    {
+        typename CountTypeOf<E>::type any(0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            any |= CountOf(piles[i]);
+        }
+        return IsZero(any);
+    }
+
+    // Index of the first pile that shrinks when xor'd with sum, i.e. the
+    // first pile that has the highest set bit of sum, or count if none
+    template <typename E>
+    size_t FindShrinkingPile(const E* piles, size_t count, const typename CountTypeOf<E>::type& sum)
+    {
+        const size_t BLOCK = 16;
+        auto bit = HighestBitIndex(sum);
+        size_t i = 0;
+        // branch-free test of whole blocks, only the hit block is rescanned
+        for (; i + BLOCK <= count; i += BLOCK)
+        {
+            decltype(BitOf(sum, bit)) hit = 0;
+            for (size_t j = 0; j < BLOCK; ++j)
+            {
+                hit |= BitOf(CountOf(piles[i + j]), bit);
+            }
+            if (hit) { break; }
+        }
+        for (; i < count; ++i)
+        {
+            if (BitOf(CountOf(piles[i]), bit)) { return i; }
+        }
+        return count;
+    }
+
+    template <typename E>
+    size_t FindBiggestPile(const E* piles, size_t count)
+    {
+        size_t max_index = 0;
+        for (size_t i = 1; i < count; ++i)
+        {
+            if (CountOf(piles[i]) > CountOf(piles[max_index])) { max_index = i; }
+        }
+        return max_index;
+    }
+
+    // Winning move if there is one, otherwise a single chip from the biggest
+    // pile. Only meaningful while !AllEmpty(piles, count).
+    template <typename E>
+    BasicMove<typename CountTypeOf<E>::type> CPUMove(const E* piles, size_t count)
+    {
+        using T = typename CountTypeOf<E>::type;
+        auto sum = NimSum(piles, count);
+        if (!IsZero(sum))
+        {
+            auto index = FindShrinkingPile(piles, count, sum);
+            if (index < count)
+            {
+                // leaving (pile ^ sum) chips zeroes the nim-sum
+                const T& pile = CountOf(piles[index]);
+                return { T(pile - (pile ^ sum)), int32(index) };
+            }
+        }
+
+        // no good moves, take 1 from biggest pile
+        return { T(1), int32(FindBiggestPile(piles, count)) };
+    }
+
+    template <typename T>
+    T NimSum(const BasicPosition<T>& position)
+    {
+        return NimSum(position.Data(), position.PileCount());
+    }
+
+    template <typename T>
+    bool AllEmpty(const BasicPosition<T>& position)
+    {
+        return AllEmpty(position.Data(), position.PileCount());
+    }
+
+    template <typename T>
+    BasicMove<T> CPUMove(const BasicPosition<T>& position)
+    {
+        return CPUMove(position.Data(), position.PileCount());
+    }
+}
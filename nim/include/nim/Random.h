@@ -0,0 +1,95 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Export.h"
+
+namespace nim
+{
+    // xoshiro256** generator. Small, fast and owned by whoever uses it, so
+    // threads never share (or lock) random state. The same (seed, stream)
+    // always yields the same sequence: a simulation that seeds game i with
+    // stream i replays bit for bit however its games are spread over
+    // threads.
+    class Random
+    {
+    public:
+        explicit Random(uint64 seed = 0, uint64 stream = 0)
+        {
+            Seed(seed, stream);
+        }
+
+        void Seed(uint64 seed, uint64 stream = 0)
+        {
+            // splitmix64 expands (seed, stream) into a well-mixed, never
+            // all-zero state; the stream goes through its own round first so
+            // neighbouring seeds and streams do not overlap
+            auto x = seed ^ SplitMix(stream);
+            for (auto& word : state)
+            {
+                word = SplitMix(x);
+            }
+        }
+
+        uint64 Next()
+        {
+            auto result = Rotl(state[1] * 5, 7) * 9;
+            auto t = state[1] << 17;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = Rotl(state[3], 45);
+            return result;
+        }
+
+        // Uniform in [0, bound), bound > 0, without modulo bias (Lemire's
+        // multiply-shift with rejection)
+        uint32 Below(uint32 bound)
+        {
+            auto m = uint64(uint32(Next() >> 32)) * bound;
+            auto low = uint32(m);
+            if (low < bound)
+            {
+                auto threshold = uint32(-bound) % bound;
+                while (low < threshold)
+                {
+                    m = uint64(uint32(Next() >> 32)) * bound;
+                    low = uint32(m);
+                }
+            }
+            return uint32(m >> 32);
+        }
+
+        bool Coin()
+        {
+            return (Next() >> 63) != 0;
+        }
+
+        // Independent generator for a worker, derived from this one's output
+        Random Split()
+        {
+            auto seed = Next();
+            return Random(seed, Next());
+        }
+
+    private:
+        static uint64 Rotl(uint64 x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        static uint64 SplitMix(uint64& x)
+        {
+            auto z = (x += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+        uint64 state[4];
+    };
+
+    // A seed that differs from run to run, for when none was given
+    NIM_API uint64 EntropySeed();
+}
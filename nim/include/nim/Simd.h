@@ -0,0 +1,48 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Export.h"
+#include "Position.h"
+#include <cstddef>
+
+namespace nim
+{
+    // Vectorized kernels over plain arrays of 32 and 64-bit pile counts, for
+    // positions with very many piles. The instruction set is picked once at
+    // run time from what the CPU supports; every kernel has a portable
+    // scalar version that gives identical results.
+    namespace simd
+    {
+        enum class Isa
+        {
+            Scalar,
+            SSE42,
+            AVX2
+        };
+
+        // Best instruction set supported by this CPU (and build)
+        NIM_API Isa BestIsa();
+        NIM_API Isa ActiveIsa();
+        // Forces a (lower) instruction set, e.g. for benchmarking. Not
+        // synchronized with kernels running on other threads.
+        NIM_API bool SetIsa(Isa isa);
+        NIM_API const char* IsaName(Isa isa);
+
+        NIM_API uint32 NimSum(const uint32* counts, size_t count);
+        NIM_API uint64 NimSum(const uint64* counts, size_t count);
+
+        // Index of the first pile with (count ^ sum) < count, or count if
+        // none. sum must be nonzero.
+        NIM_API size_t FindShrinkingPile(const uint32* counts, size_t count, uint32 sum);
+        NIM_API size_t FindShrinkingPile(const uint64* counts, size_t count, uint64 sum);
+
+        // Writes the indices of up to max_indices such piles, in order, and
+        // returns how many there are in total
+        NIM_API size_t FindShrinkingPiles(const uint32* counts, size_t count, uint32 sum, int32* indices, size_t max_indices);
+        NIM_API size_t FindShrinkingPiles(const uint64* counts, size_t count, uint64 sum, int32* indices, size_t max_indices);
+
+        // Same result as nim::CPUMove on the same counts
+        NIM_API BasicMove<uint32> CPUMove(const uint32* counts, size_t count);
+        NIM_API BasicMove<uint64> CPUMove(const uint64* counts, size_t count);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Export.h"
+#include "Game.h"
+#include "ThreadPool.h"
+
+namespace nim
+{
+    // Who plays against the CPU in a simulated game
+    enum class Opponent
+    {
+        CPU,        // the same strategy on both sides
+        Random      // a uniformly random pile, then a random number from it
+    };
+
+    struct SimulationOptions
+    {
+        uint64 Games = 0;
+        int32 PileCount = Game::PILE_COUNT;
+        Opponent Player2 = Opponent::CPU;   // player 1 is always the CPU
+        // Game i draws its piles, first turn and random moves from stream i
+        // of this seed, so the results do not depend on the thread count
+        uint64 Seed = 0;
+    };
+
+    struct SimulationStats
+    {
+        uint64 Games = 0;
+        uint64 Moves = 0;
+        uint64 Player1Wins = 0;
+        uint64 FirstMoverWins = 0;      // won by whoever moved first
+        uint64 WinningStarts = 0;       // first mover faced a non-zero nim-sum
+        double Seconds = 0;
+    };
+
+    // Plays options.Games complete games in memory, with no I/O, spread
+    // over pool (or on the calling thread without one). Each chunk of games
+    // gets its own Game, so the threads share nothing but the totals.
+    NIM_API SimulationStats Simulate(const SimulationOptions& options, ThreadPool* pool = nullptr);
+}
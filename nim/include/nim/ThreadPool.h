@@ -0,0 +1,49 @@
+#pragma once
+
+#include "nim_stdtypes.h"
+#include "nim_Export.h"
+#include <cstddef>
+
+namespace nim
+{
+    // Fixed set of worker threads for data-parallel loops. A loop hands out
+    // chunks of its index range through an atomic counter and the calling
+    // thread works along; nothing is allocated per loop.
+    class NIM_API ThreadPool final
+    {
+    public:
+        // Body of a loop: processes indices [begin, end)
+        using Task = void(*)(void* context, size_t begin, size_t end);
+
+        // 0 threads means one per hardware thread
+        explicit ThreadPool(size_t threads = 0);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ~ThreadPool();
+
+        // Threads working on a loop, including the caller
+        size_t ThreadCount() const;
+
+        // Runs task over [0, count) in chunks of grain indices and returns
+        // once all of them are done. Tasks must not throw.
+        void ParallelFor(size_t count, size_t grain, Task task, void* context);
+
+        template <typename F>
+        void ParallelFor(size_t count, size_t grain, F& body)
+        {
+            ParallelFor(count, grain, &Invoke<F>, &body);
+        }
+
+    private:
+        template <typename F>
+        static void Invoke(void* context, size_t begin, size_t end)
+        {
+            (*static_cast<F*>(context))(begin, end);
+        }
+
+        void Shutdown();
+
+        struct impl;
+        impl* m_impl;
+    };
+}
@@ -2,4 +2,8 @@
 
 #include "nim_stdtypes.h"
 #include "nim_Assert.h"
+#include "Game.h"
+#include "Batch.h"
+#include "Simulator.h"
+#include "nim_core.h"
 #include "Application.h"
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+// Symbol visibility for the nimcore library. Only needed when nimcore is
+// built as a Windows DLL, everywhere else this expands to nothing.
+#if defined(_WIN32) && defined(NIM_CORE_SHARED)
+#   ifdef nimcore_EXPORTS
+#       define NIM_API __declspec(dllexport)
+#   else
+#       define NIM_API __declspec(dllimport)
+#   endif
+#else
+#   define NIM_API
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+
+/*
+ * Plain C interface to the headless NIM engine (nimcore).
+ *
+ * Piles are addressed by zero-based index. Every function that can fail
+ * returns a nim_result; out-parameters are left untouched on failure.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "nim_Export.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nim_game nim_game;
+typedef struct nim_thread_pool nim_thread_pool;
+
+typedef enum nim_result
+{
+    NIM_OK = 0,
+    NIM_ERR_PILE_RANGE,
+    NIM_ERR_PILE_EMPTY,
+    NIM_ERR_NUMBER_RANGE,
+    NIM_ERR_ARGUMENT,
+    NIM_ERR_GAME_OVER,
+    NIM_ERR_OUT_OF_MEMORY
+} nim_result;
+
+/* Creates a classic 3-pile game; NULL if out of memory. */
+NIM_API nim_game* nim_game_create(void);
+/* Creates a game with pile_count random piles; NULL if pile_count < 1. */
+NIM_API nim_game* nim_game_create_with_piles(int32_t pile_count);
+NIM_API void nim_game_destroy(nim_game* game);
+
+/* Restarts the game's random sequence (used by randomize); games are
+ * seeded from the system's entropy source by default. */
+NIM_API void nim_game_seed(nim_game* game, uint64_t seed);
+/* NIM_ERR_OUT_OF_MEMORY if the game's index cannot grow, as for set_pile. */
+NIM_API nim_result nim_game_randomize(nim_game* game);
+NIM_API int32_t nim_game_pile_count(const nim_game* game);
+NIM_API nim_result nim_game_get_pile(const nim_game* game, int32_t pile, int32_t* count);
+/* set_pile and take return NIM_ERR_OUT_OF_MEMORY if the game's index
+ * cannot grow; the game then has to be reset with set_piles. */
+NIM_API nim_result nim_game_set_pile(nim_game* game, int32_t pile, int32_t count);
+/* Replaces the whole position with pile_count piles read from counts. */
+NIM_API nim_result nim_game_set_piles(nim_game* game, const int32_t* counts, int32_t pile_count);
+
+NIM_API int nim_game_player1_turn(const nim_game* game);
+NIM_API void nim_game_set_player1_turn(nim_game* game, int player1_turn);
+NIM_API void nim_game_switch_turn(nim_game* game);
+
+/* Applies a move. Whose turn it is stays with the caller (see switch_turn). */
+NIM_API nim_result nim_game_take(nim_game* game, int32_t number, int32_t pile);
+/* Computes the CPU's move for the current position without applying it. */
+NIM_API nim_result nim_game_cpu_move(const nim_game* game, int32_t* number, int32_t* pile);
+NIM_API int32_t nim_game_nim_sum(const nim_game* game);
+NIM_API int nim_game_over(const nim_game* game);
+
+/*
+ * Stateless analysis of a position given as a plain array of pile counts,
+ * for heaps wider than the game's 32-bit piles. Vectorized with the best
+ * instruction set the CPU supports. A position whose piles are all empty
+ * yields NIM_ERR_GAME_OVER.
+ */
+NIM_API uint32_t nim_position_nim_sum_u32(const uint32_t* counts, size_t pile_count);
+NIM_API uint64_t nim_position_nim_sum_u64(const uint64_t* counts, size_t pile_count);
+NIM_API nim_result nim_position_cpu_move_u32(const uint32_t* counts, size_t pile_count, uint32_t* number, int32_t* pile);
+NIM_API nim_result nim_position_cpu_move_u64(const uint64_t* counts, size_t pile_count, uint64_t* number, int32_t* pile);
+
+/*
+ * Indices of the piles a winning move can be made from (count ^ nim-sum <
+ * count), in order. Writes at most max_indices of them and returns how many
+ * there are in total; 0 for a losing position.
+ */
+NIM_API size_t nim_position_winning_piles_u32(const uint32_t* counts, size_t pile_count, int32_t* indices, size_t max_indices);
+NIM_API size_t nim_position_winning_piles_u64(const uint64_t* counts, size_t pile_count, int32_t* indices, size_t max_indices);
+
+/*
+ * The same for 128-bit piles, in two 64-bit halves: pile i is
+ * counts[2 * i] (low) and counts[2 * i + 1] (high), and nim_sum and number
+ * point at two halves in the same order. Not vectorized.
+ */
+NIM_API void nim_position_nim_sum_u128(const uint64_t* counts, size_t pile_count, uint64_t* nim_sum);
+NIM_API nim_result nim_position_cpu_move_u128(const uint64_t* counts, size_t pile_count, uint64_t* number, int32_t* pile);
+NIM_API size_t nim_position_winning_piles_u128(const uint64_t* counts, size_t pile_count, int32_t* indices, size_t max_indices);
+
+/*
+ * Batch analysis of many positions stored back to back in counts. Position
+ * i is counts[offsets[i], offsets[i + 1]) or, when offsets is NULL,
+ * pile_count piles starting at counts[i * pile_count]. Every output array
+ * is caller-owned and optional (NULL skips it):
+ *   winning         1 for a winning position (N), 0 for a losing one (P)
+ *   nim_sums        nim-sum of each position
+ *   move_numbers,   first winning move, {0, -1} for a losing position
+ *   move_piles
+ *   winning_piles,  all winning moves, laid out like counts: those of
+ *   winning_numbers position i start at its first pile's offset
+ *   winning_counts  number of winning moves of each position
+ * Nothing is allocated. With a pool the positions are split among its
+ * threads; the call returns once all of them are done.
+ */
+typedef struct nim_batch_u32
+{
+    const uint32_t* counts;
+    const size_t* offsets;
+    size_t pile_count;
+    size_t position_count;
+
+    uint8_t* winning;
+    uint32_t* nim_sums;
+    uint32_t* move_numbers;
+    int32_t* move_piles;
+    int32_t* winning_piles;
+    uint32_t* winning_numbers;
+    size_t* winning_counts;
+} nim_batch_u32;
+
+typedef struct nim_batch_u64
+{
+    const uint64_t* counts;
+    const size_t* offsets;
+    size_t pile_count;
+    size_t position_count;
+
+    uint8_t* winning;
+    uint64_t* nim_sums;
+    uint64_t* move_numbers;
+    int32_t* move_piles;
+    int32_t* winning_piles;
+    uint64_t* winning_numbers;
+    size_t* winning_counts;
+} nim_batch_u64;
+
+/* thread_count 0 means one per hardware thread (the caller included). */
+NIM_API nim_thread_pool* nim_thread_pool_create(size_t thread_count);
+NIM_API void nim_thread_pool_destroy(nim_thread_pool* pool);
+NIM_API size_t nim_thread_pool_thread_count(const nim_thread_pool* pool);
+
+/* pool may be NULL to run on the calling thread. */
+NIM_API nim_result nim_batch_analyze_u32(const nim_batch_u32* batch, nim_thread_pool* pool);
+NIM_API nim_result nim_batch_analyze_u64(const nim_batch_u64* batch, nim_thread_pool* pool);
+
+/* Instruction set the position kernels dispatched to: "scalar", "sse4.2" or "avx2". */
+NIM_API const char* nim_simd_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
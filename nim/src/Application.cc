@@ -1,18 +1,41 @@
 #include <nim/Application.h>
 #include <nim/nim_Assert.h>
+#include <nim/Game.h>
+#include <nim/Simulator.h>
+#include <nim/ThreadPool.h>
 #include <vector>
 #include <map>
 #include <string>
 #include <sstream>
 #include <cstdlib>
 #include <iostream>
+#include <fstream>
 #include <utility>
 #include <algorithm>
 #include <iomanip>
-#include <bitset>
+#include <limits>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "tinycon.h"
 #include "rlutil.h"
 #include "parse.hpp"
+#include "command.hpp"
+#include "input.hpp"
+#include "output.hpp"
+#include "json.hpp"
+#include "server.hpp"
+#include "uring.hpp"
+#include "shm.hpp"
+#include "snapshot.hpp"
 
 using std::vector;
 using std::map;
@@ -31,12 +54,8 @@ using std::setw;
 using std::left;
 using std::right;
 using std::streamsize;
-using std::bitset;
 using nim::int32;
 
-#define PILE_MAX 20
-#define PILE_MIN 10
-
 #define CONSOLE_WIDTH 80
 #define DESCRIPTION_WIDTH 50
 
@@ -45,75 +64,108 @@ using nim::int32;
 #define ERR_ARGUMENT "ArgumentError"
 #define ERR_RANGE "RangeError"
 
+#define WELCOME_TEXT "  Welcome to the interactive NIM. Type 'how2play' for instructions and rules.\n" \
+                     "  Type 'help' for detailed help.\n"
+#define OPPONENT_QUESTION "  Would you like to play against a CPU or a human? {cpu|human}\n"
+
 namespace nim
 {
     namespace detail
     {
-        struct Pile
-        {
-            Pile& operator =(int32 new_count);
-            Pile& operator =(const Pile& other);
-            Pile& operator --();
-            Pile& operator ++();
-            Pile operator --(int32);
-            Pile operator ++(int32);
-            Pile& operator -=(int32 diff);
-            Pile& operator -=(const Pile& other);
-            Pile& operator +=(int32 diff);
-            Pile& operator +=(const Pile& other);
+        // Utils
+
+        static void lowercase(string& s);
 
-            bool operator ==(int32 other_count) const;
-            bool operator ==(const Pile& other) const;
+        // Parses a whole token as a base 10 integer
+        static bool parse_token(const StringView& token, int32* value);
 
-            void Rnd();
+        static vector<string> word_wrap_fill(const string& text, size_t line_length);
 
-            int32 Count() const;
-            operator int32() const;
+        static string print_err(const string& err_type);
 
-            Pile();
-            Pile(int32 new_count);
+        // Command line options
 
-        private:
-            int32 count;
+        struct Options
+        {
+            int32 PileCount = Game::PILE_COUNT;
+
+            // --simulate: play this many games headless instead of the console
+            int64 SimulateGames = 0;
+            int32 Threads = 0;      // simulation workers or server shards, 0 for one per hardware thread
+            Opponent SimulateOpponent = Opponent::CPU;
+
+            // --script: read commands from this file instead of the keyboard
+            string ScriptPath;
+
+            // --seed: replay a game or simulation; a fresh one otherwise
+            bool HasSeed = false;
+            uint64 Seed = 0;
+
+            // --async-output: console output is written by its own thread
+            bool AsyncOutput = false;
+
+            // --protocol jsonl: one JSON request and one JSON reply per line,
+            // for programs rather than people, on stdin/stdout or --serve
+            bool JsonLines = false;
+
+            // --shm: serve one client through a shared-memory channel of
+            // this name in /dev/shm instead of the console
+            string ShmName;
+
+            // --serve: host games over TCP on this port instead of the console
+            int32 ServePort = -1;
+            string BindAddress = "0.0.0.0";
+            // --stats: seconds between reports of the server's shards, 0 for none
+            int32 StatsInterval = 10;
+            // --io: the server's event loops on io_uring where the kernel
+            // has it (falling back to epoll), or on epoll regardless
+            bool UseUring = true;
         };
 
+        static bool ParseOptions(const vector<string>& args, Options& options);
 
-        // Utils
+        static void RunSimulation(const Options& options);
 
-        template <typename T>
-        static vector<T>& split(const T& s, vector<T>& elems);
-        template <typename T>
-        static vector<T> split(const T& s);
+        static int RunServer(const Options& options);
 
-        static void lowercase(string& s);
+        static int RunJsonLines(const Options& options);
 
-        static vector<string> word_wrap_fill(const string& text, size_t line_length);
+        static int RunShm(const Options& options);
 
-        static string print_err(const string& err_type);
+        // File descriptor of a script file opened for reading, -1 on failure
+        static int OpenScript(const string& path);
+
+        struct ScriptCloser
+        {
+            int Fd;
+            ~ScriptCloser();
+        };
 
-        struct NimImpl
+        struct NimImpl : public Game
         {
             vector<string> Cmd;
-            Pile Piles[3];
-            bool Player1Turn;
-            bool CPU;
             tinyConsole* Console;
 
             string Player1Name;
             string Player2Name;
             string CPUName;
+            string Prompt;
 
             bool Quit;
 
-            void DecideTurn()
-            {
-                Player1Turn = (::rand() % 2) ? true : false;
-            }
+            // Where the game and its commands print: the console, or a
+            // network session's output buffer
+            ostream* Out = &cout;
 
-            void SwitchTurn()
-            {
-                Player1Turn ^= true;
-            }
+            // Moves made by either side, for the server's move rate
+            uint64 Moves = 0;
+
+            // Whether save and load may touch files: not for network
+            // players, whose paths would be on the server's disk
+            bool FileCommands = true;
+
+            // Piles of the snapshot being restored, kept for the next one
+            vector<int32> LoadBuffer;
 
             void SetCurrentPlayerName(const string& prompt)
             {
@@ -125,13 +177,6 @@ namespace nim
                 return ((Player1Turn) ? Player1Name : Player2Name);
             }
 
-            void Rnd()
-            {
-                Piles[0].Rnd();
-                Piles[1].Rnd();
-                Piles[2].Rnd();
-            }
-
             void Restart()
             {
                 Rnd();
@@ -139,111 +184,187 @@ namespace nim
                 StartTurn();
             }
 
-            void StartTurn()
+            // Turn flow as an explicit state machine: each state does its
+            // part and names the next one, and Advance steps it until a
+            // human has to move or the game is over. Commands resume it from
+            // where they left off, so no turn calls the next one and the
+            // stack stays flat however many turns are played in a row.
+            enum class TurnState
             {
-                UpdatePrompt();
-                ShowPiles();
-                if (CPU && !Player1Turn)
-                {
-                    CPUTurn();
-                }
-            }
-
-            void CPUTurn()
+                Start,          // show the position, then hand over to whoever moves
+                CPUMove,        // the CPU takes its move
+                Next,           // a move was made: end the game or switch turns
+                AwaitingInput,  // a human has to enter a move
+                Over
+            };
+
+            TurnState State = TurnState::AwaitingInput;
+
+            // Runs one state. False when the machine has to wait, for a
+            // human's move or for a new game.
+            bool Step()
             {
-                // int(ceil(log2(PILE_MAX)))
-#define BITSET_MAX 5
-                bitset<BITSET_MAX> state(0);
-
-                for (auto i = (BITSET_MAX - 1); i >= 0; --i)
-                {
-                    // odd check for each bit
-                    state.set(i, !!((((Piles[0] >> i) & 1) + ((Piles[1] >> i) & 1) + ((Piles[2] >> i) & 1)) & 1));
-                }
-
-                auto move_made = false;
-                for (auto i = (BITSET_MAX - 1); i >= 0; --i)
+                switch (State)
                 {
-                    // highest set bit
-                    if (state.test(i))
+                    case TurnState::Start:
+                        UpdatePrompt();
+                        ShowPiles();
+                        State = (CPU && !Player1Turn) ? TurnState::CPUMove : TurnState::AwaitingInput;
+                        return true;
+                    case TurnState::CPUMove:
                     {
-                        for (auto j = 0; j < (BITSET_MAX - 1); ++j)
+                        auto move = CPUMove();
+                        CPUTake(move.Number, move.Pile);
+                        State = TurnState::Next;
+                        return true;
+                    }
+                    case TurnState::Next:
+                        if (GameOver())
                         {
-                            // pile with highest set bit
-                            if ((Piles[j] >> i) & 1)
+                            if (Player1Turn || !CPU)
+                            {
+                                *Out << "  Congratulations, " << GetCurrentPlayerName() << "! You have won!";
+                            }
+                            else
                             {
-                                // xor for state 00000
-                                auto target = (state ^ bitset<BITSET_MAX>(Piles[j])).to_ulong();
-                                CPUTake(Piles[j] - int32(target), j);
-                                move_made = true;
-                                break;
+                                *Out << "  The CPU has won the game.";
                             }
+                            *Out << "\n\n";
+                            Console->quit();
+                            State = TurnState::Over;
                         }
+                        else
+                        {
+                            SwitchTurn();
+                            State = TurnState::Start;
+                        }
+                        return true;
+                    case TurnState::AwaitingInput:
+                    case TurnState::Over:
                         break;
-                    }
                 }
+                return false;
+            }
 
-                // no good moves, take 1 from biggest pile
-                if (!move_made)
-                {
-                    auto max_index = 0;
-                    for (auto j = 1; j < (BITSET_MAX - 1); ++j)
-                    {
-                        if (Piles[j] > Piles[max_index]) { max_index = j; }
-                    }
-                    CPUTake(1, max_index);
-                }
+            void Advance(TurnState from)
+            {
+                State = from;
+                while (Step()) {}
+            }
+
+            void StartTurn()
+            {
+                Advance(TurnState::Start);
+            }
 
-                NextTurn();
+            void CPUTurn()
+            {
+                Advance(TurnState::CPUMove);
             }
 
             void CPUTake(int32 num, int32 pile)
             {
-                cout << CPUName << "> " << "take " << num << " from " << (pile + 1) << "\n";
-                Piles[pile] -= num;
+                ++Moves;
+                *Out << CPUName << "> " << "take " << num << " from " << (pile + 1) << "\n";
+                Take(num, pile);
             }
 
             void UpdatePrompt()
             {
-                Console->setPrompt(GetCurrentPlayerName() + "> ");
+                // built in a reused buffer, so a turn does not allocate
+                Prompt.assign(GetCurrentPlayerName());
+                Prompt += "> ";
+                Console->setPrompt(Prompt);
             }
 
+            // After a human's move
             void NextTurn()
             {
-                if (GameOver())
-                {
-                    if (Player1Turn || !CPU)
-                    {
-                        cout << "  Congratulations, " << GetCurrentPlayerName() << "! You have won!";
-                    }
-                    else
-                    {
-                        cout << "  The CPU has won the game.";
-                    }
-                    cout << "\n\n";
-                    Console->quit();
-                }
-                else
-                {
-                    SwitchTurn();
-                    StartTurn();
-                }
+                Advance(TurnState::Next);
             }
 
             void ShowPiles()
             {
-                cout << *this << "\n";
+                *Out << *this << "\n";
             }
 
-            friend ostream& operator <<(ostream& os, const NimImpl& i)
+            // Appends a snapshot of the session (see snapshot.hpp) to out.
+            // With a name table, names are interned into it and the
+            // snapshot can only be restored with that same table.
+            void Save(string& out, NameTable* names = nullptr) const
             {
-                os << "  " << i.Piles[0] << "  " << i.Piles[1] << "  " << i.Piles[2];
-                return os;
+                out.append(SNAPSHOT_MAGIC, sizeof SNAPSHOT_MAGIC);
+                PutVarint(out, SNAPSHOT_VERSION);
+                out.push_back(char((Player1Turn ? 1 : 0) | (CPU ? 2 : 0)));
+                PutName(out, Player1Name, names);
+                PutName(out, Player2Name, names);
+                PutName(out, CPUName, names);
+                PutVarint(out, uint64(PileCount()));
+                for (auto i = 0; i < PileCount(); ++i)
+                {
+                    PutVarint(out, uint64(int32(GetPile(i))));
+                }
+            }
+
+            // Replaces the piles, turn, opponent and names with a snapshot's;
+            // nothing changes unless the whole snapshot is good. The turn is
+            // not started, so the caller decides what to show.
+            RestoreResult Load(const char* data, size_t size, const NameTable* names = nullptr)
+            {
+                SnapshotReader reader(data, size);
+                StringView magic;
+                uint64 version;
+                uint8 flags;
+                if (!reader.Bytes(sizeof SNAPSHOT_MAGIC, magic) || std::memcmp(magic.Data, SNAPSHOT_MAGIC, sizeof SNAPSHOT_MAGIC) != 0 ||
+                    !reader.Varint(version))
+                {
+                    return RestoreResult::Malformed;
+                }
+                if (version != SNAPSHOT_VERSION) { return RestoreResult::Version; }
+                if (!reader.Byte(flags) || flags > 3) { return RestoreResult::Malformed; }
+
+                const auto& table = names ? *names : DefaultNames();
+                StringView player1, player2, cpu;
+                auto result = reader.Name(table, player1);
+                if (result == RestoreResult::Ok) { result = reader.Name(table, player2); }
+                if (result == RestoreResult::Ok) { result = reader.Name(table, cpu); }
+                if (result != RestoreResult::Ok) { return result; }
+
+                // every pile takes a byte at least, so a count bigger than
+                // what is left is corrupt rather than a reason to allocate
+                uint64 pile_count;
+                if (!reader.Varint(pile_count) || pile_count == 0 || pile_count > reader.Remaining())
+                {
+                    return RestoreResult::Malformed;
+                }
+                LoadBuffer.resize(size_t(pile_count));
+                auto chips = false;
+                for (auto& pile : LoadBuffer)
+                {
+                    uint64 count;
+                    if (!reader.Varint(count) || count > uint64(std::numeric_limits<int32>::max())) { return RestoreResult::Malformed; }
+                    pile = int32(count);
+                    chips = chips || count != 0;
+                }
+                if (!reader.AtEnd()) { return RestoreResult::Malformed; }
+                if (!chips) { return RestoreResult::Finished; }
+
+                SetPiles(LoadBuffer.data(), int32(pile_count));
+                Player1Turn = (flags & 1) != 0;
+                CPU = (flags & 2) != 0;
+                Player1Name.assign(player1.Data, player1.Size);
+                Player2Name.assign(player2.Data, player2.Size);
+                CPUName.assign(cpu.Data, cpu.Size);
+                return RestoreResult::Ok;
             }
 
-            bool GameOver() const
+            friend ostream& operator <<(ostream& os, const NimImpl& i)
             {
-                return (Piles[0] == 0) && (Piles[1] == 0) && (Piles[2] == 0);
+                for (auto j = 0; j < i.PileCount(); ++j)
+                {
+                    os << "  " << i.GetPile(j);
+                }
+                return os;
             }
         };
     }
@@ -257,10 +378,13 @@ namespace nim
     namespace detail
     {
 
+        // Tokens of one command line, views into the line itself
+        using Args = vector<StringView>;
+
         struct ConsoleCmd
         {
-            string Name;
-            void(*Callback)(NimImpl* nimpl, const vector<string>& parts);
+            StringView Name;
+            void(*Callback)(NimImpl* nimpl, const Args& parts);
         };
 
         struct ConsoleCmdDesc
@@ -269,44 +393,95 @@ namespace nim
             vector<string> Description; // lines of description for using command
         };
 
-        static void CmdHelp(NimImpl*, const vector<string>&);
-        static void CmdShow(NimImpl*, const vector<string>&);
-        static void CmdTake(NimImpl*, const vector<string>&);
-        static void CmdName(NimImpl*, const vector<string>&);
-        static void CmdHow2Play(NimImpl*, const vector<string>&);
-        static void CmdRestart(NimImpl*, const vector<string>&);
-        static void CmdExit(NimImpl*, const vector<string>&);
-        static void CmdRq(NimImpl*, const vector<string>&);
-        static void CmdColor(NimImpl*, const vector<string>&);
+        static void CmdHelp(NimImpl*, const Args&);
+        static void CmdShow(NimImpl*, const Args&);
+        static void CmdTake(NimImpl*, const Args&);
+        static void CmdName(NimImpl*, const Args&);
+        static void CmdHow2Play(NimImpl*, const Args&);
+        static void CmdRestart(NimImpl*, const Args&);
+        static void CmdExit(NimImpl*, const Args&);
+        static void CmdRq(NimImpl*, const Args&);
+        static void CmdColor(NimImpl*, const Args&);
+        static void CmdSave(NimImpl*, const Args&);
+        static void CmdLoad(NimImpl*, const Args&);
 
         // Set up word wrapping for help
         static void WordWrapSetUp();
 
         static map<string, ConsoleCmdDesc> ConsoleCmdDescs = {
             { "help", { "help [command_name]...", { "Display the help screen (or the help for specified commands only)." } } },
-            { "show", { "show [pile]...", { "Show the piles (or the specified piles in the order of [pile], and valid pile is one of {1,2,3} corresponding to the pile number)" } } },
-            { "take", { "[take] <number> [from] <pile>", { "Take <number> of chips (in range [1, pile length]) from <pile>-th pile (in range [1, 3])." } } },
+            { "show", { "show [pile]...", { "Show the piles (or the specified piles in the order of [pile], and valid pile is in range [1, number of piles] corresponding to the pile number)" } } },
+            { "take", { "[take] <number> [from] <pile>", { "Take <number> of chips (in range [1, pile length]) from <pile>-th pile (in range [1, number of piles])." } } },
             { "name", { "name <name>", { "Set your name to <name>. Special characters and spaces are allowed (case-sensitive)." } } },
             { "how2play", { "how2play", { "Print rules of the game and how to play NIM with this program." } } },
             { "restart", { "restart [cpu|human]", { "Restart game with either CPU or human opponent." } } },
             { "exit", { "exit", { "Exit the entire program." } } },
             { "rq", { "rq", { "Ragequit." } } },
-            { "color", { "color <color>", { "Sets the font color to <color> (one of {blue, green, cyan, red, magenta, brown, grey, darkgrey, lightblue, lightgreen, lightcyan, lightred, lightmagenta, yellow, white} (case-insensitive))." } } }
+            { "color", { "color <color>", { "Sets the font color to <color> (one of {blue, green, cyan, red, magenta, brown, grey, darkgrey, lightblue, lightgreen, lightcyan, lightred, lightmagenta, yellow, white} (case-insensitive))." } } },
+            { "save", { "save <file>", { "Save the game (piles, turn, opponent and names) to <file>." } } },
+            { "load", { "load <file>", { "Continue a game saved with 'save' to <file>, in place of this one." } } }
         };
 
-        static const ConsoleCmd Commands[] = {
-            { "help", &CmdHelp },
-            { "show", &CmdShow },
-            { "take", &CmdTake },
-            { "name", &CmdName },
-            { "how2play", &CmdHow2Play },
-            { "restart", &CmdRestart },
-            { "exit", &CmdExit },
-            { "rq", &CmdRq },
-            { "color", &CmdColor },
+        // Commands are found through a perfect hash of (length, first char,
+        // last char), case-folded; each command sits in the slot its name
+        // hashes to, which the static_assert below checks
+        #define COMMAND_SLOTS 32
+
+        constexpr uint32 CommandHash(const char* name, size_t length)
+        {
+            return length == 0 ? 0 :
+                (uint32(length) + uint32(FoldCase(name[0])) * 5 + uint32(FoldCase(name[length - 1])) * 13) & (COMMAND_SLOTS - 1);
+        }
+
+        static constexpr ConsoleCmd Commands[COMMAND_SLOTS] = {
+            { "", nullptr },
+            { "exit", &CmdExit },           // 1
+            { "", nullptr },
+            { "", nullptr },
+            { "save", &CmdSave },           // 4
+            { "restart", &CmdRestart },     // 5
+            { "", nullptr },
+            { "", nullptr },
+            { "", nullptr },
+            { "take", &CmdTake },           // 9
+            { "", nullptr },
+            { "name", &CmdName },           // 11
+            { "", nullptr },
+            { "", nullptr },
+            { "show", &CmdShow },           // 14
+            { "", nullptr },
+            { "", nullptr },
+            { "", nullptr },
+            { "", nullptr },
+            { "", nullptr },
+            { "load", &CmdLoad },           // 20
+            { "how2play", &CmdHow2Play },   // 21
+            { "", nullptr },
+            { "", nullptr },
+            { "", nullptr },
+            { "rq", &CmdRq },               // 25
+            { "", nullptr },
+            { "", nullptr },
+            { "help", &CmdHelp },           // 28
+            { "", nullptr },
+            { "color", &CmdColor },         // 30
             { "", nullptr }
         };
 
+        constexpr bool IsPerfectHashTable(size_t slot)
+        {
+            return slot == COMMAND_SLOTS ||
+                ((Commands[slot].Callback == nullptr || CommandHash(Commands[slot].Name.Data, Commands[slot].Name.Size) == slot) && IsPerfectHashTable(slot + 1));
+        }
+
+        static_assert(IsPerfectHashTable(0), "a command is not in the slot its name hashes to");
+
+        static const ConsoleCmd* FindCommand(const StringView& name)
+        {
+            const auto& cmd = Commands[CommandHash(name.Data, name.Size)];
+            return (cmd.Callback && EqualsIgnoreCase(cmd.Name, name)) ? &cmd : nullptr;
+        }
+
         static const map<string, int> ColorsMap = {
             { "black", rlutil::BLACK },
             { "blue", rlutil::BLUE },
@@ -330,53 +505,181 @@ namespace nim
         {
             NimConsole(NimImpl* g) : tinyConsole("player>"), game(g) {}
 
-            virtual int trigger(string s) override
+            virtual int trigger(const string& s) override
             {
-                vector<string> parts;
-                split(s, parts);
-                if (parts.size() == static_cast<size_t>(0)) { return 0; }
-                string& cmd_name = parts[0];
-                lowercase(cmd_name);
-                for (auto i = 0;; ++i)
+                return Execute(StringView(s.data(), s.size()));
+            }
+
+            int Execute(const StringView& line)
+            {
+                // parts only holds views into line and keeps its capacity
+                // from one command to the next
+                Tokenize(line.Data, line.Size, parts);
+                if (parts.empty()) { return 0; }
+                if (auto cmd = FindCommand(parts[0]))
                 {
-                    auto& cmd = Commands[i];
-                    if (cmd.Name == "")
-                    {
-                        using namespace numerics;
-                        int32 test_int;
-                        if (parse_integral<int32>(cmd_name.c_str(), &test_int))
-                        {
-                            parts.insert(parts.begin(), "take");
-                            CmdTake(game, parts);
-                            return 0;
-                        }
-                        cout << print_err(ERR_SYNTAX) << "Command '" << cmd_name << "' not found. Type 'help' for list of available commands.\n";
-                        break;
-                    }
-                    else if (cmd.Name == cmd_name)
-                    {
-                        cmd.Callback(game, parts);
-                        break;
-                    }
+                    cmd->Callback(game, parts);
+                    return 0;
+                }
+                int32 test_int;
+                if (parse_token(parts[0], &test_int))
+                {
+                    parts.insert(parts.begin(), StringView("take"));
+                    CmdTake(game, parts);
+                    return 0;
                 }
+                *game->Out << print_err(ERR_SYNTAX) << "Command '" << LowerCase{ parts[0] } << "' not found. Type 'help' for list of available commands.\n";
                 return 0;
             }
 
+            // run() for scripted input: the same transcript (prompt, echoed
+            // command, output), with whole lines going straight to Execute.
+            // Returns false if the input ran out first.
+            bool RunScript(LineReader& reader)
+            {
+                // someone watching gets each command's output as it
+                // completes; a pipe or file gets it in full frames
+                auto flush_each = IsTerminal(1);
+                cout << _prompt;
+                _quit = false;
+                StringView line;
+                while (reader.ReadLine(line))
+                {
+                    cout << line << "\n";
+                    Execute(line);
+                    if (_quit) { return true; }
+                    cout << _prompt;
+                    if (flush_each) { cout.flush(); }
+                }
+                cout << "\n";
+                return false;
+            }
+
+            const string& Prompt() const { return _prompt; }
+            bool Quitting() const { return _quit; }
+            void Resume() { _quit = false; }
+
         private:
             NimImpl* game;
+            Args parts;
         };
+
+        enum class OpponentChoice
+        {
+            None,       // an empty answer
+            Invalid,    // what is wrong with it has been printed
+            Exit,
+            Chosen
+        };
+
+        // Takes the answer to OPPONENT_QUESTION
+        static OpponentChoice ChooseOpponent(NimImpl& game, const StringView& answer)
+        {
+            Args words;
+            Tokenize(answer.Data, answer.Size, words);
+            if (words.empty()) { return OpponentChoice::None; }
+            if (EqualsIgnoreCase(words[0], "exit") || EqualsIgnoreCase(words[0], "rq"))
+            {
+                return OpponentChoice::Exit;
+            }
+            if (words.size() > 1)
+            {
+                *game.Out << print_err(ERR_ARGUMENT) << "Expected only 1 argument, one of {cpu,human}.\n";
+                return OpponentChoice::Invalid;
+            }
+            if (EqualsIgnoreCase(words[0], "human"))
+            {
+                game.CPU = false;
+            }
+            else if (EqualsIgnoreCase(words[0], "cpu"))
+            {
+                game.CPU = true;
+            }
+            else
+            {
+                *game.Out << print_err(ERR_ARGUMENT) << "Expected one of {cpu,human}. Got '" << LowerCase{ words[0] } << "'.\n";
+                return OpponentChoice::Invalid;
+            }
+            return OpponentChoice::Chosen;
+        }
     }
 
     int Application::Run()
     {
         auto& game = *m_impl;
 
+        detail::Options options;
+        if (!detail::ParseOptions(game.Cmd, options))
+        {
+            return 1;
+        }
+        if (!options.HasSeed)
+        {
+            options.Seed = EntropySeed();
+        }
+        if (options.SimulateGames > 0)
+        {
+            detail::RunSimulation(options);
+            return 0;
+        }
+        if (options.ServePort >= 0)
+        {
+            return detail::RunServer(options);
+        }
+        if (!options.ShmName.empty())
+        {
+            return detail::RunShm(options);
+        }
+        if (options.JsonLines)
+        {
+            return detail::RunJsonLines(options);
+        }
+        game.Seed(options.Seed);
+        game.Resize(options.PileCount);
+
+        // Commands come from a script file, or from stdin when it is not a
+        // terminal (a pipe or a redirected file), read a block at a time
+        int script_fd = -1;
+        if (!options.ScriptPath.empty())
+        {
+            script_fd = detail::OpenScript(options.ScriptPath);
+            if (script_fd < 0)
+            {
+                cout << detail::print_err(ERR_ARGUMENT) << "Could not open script '" << options.ScriptPath << "'.\n";
+                return 1;
+            }
+        }
+        else if (!detail::IsTerminal(0))
+        {
+            script_fd = 0;
+        }
+        std::unique_ptr<detail::LineReader> script(script_fd >= 0 ? new detail::LineReader(script_fd) : nullptr);
+        detail::ScriptCloser script_closer{ script_fd };
+
+        auto read_line = [&script](string& line)
+        {
+            if (!script)
+            {
+                return bool(getline(cin, line));
+            }
+            detail::StringView view;
+            if (!script->ReadLine(view)) { return false; }
+            line.assign(view.Data, view.Size);
+            return true;
+        };
+
         game.DecideTurn();
         game.Player1Name = "player1";
         game.Player2Name = "player2";
         game.CPUName = "cpu";
         game.Quit = false;
 
+        // From here on output is gathered per command and written at once.
+        // Declared before the cursor hider, so the escape showing the
+        // cursor again still makes it into the last frame. The async writer
+        // outlives the frame buffer, so that frame is still written out.
+        std::unique_ptr<detail::AsyncWriter> async_writer(options.AsyncOutput ? new detail::AsyncWriter(1) : nullptr);
+        detail::FrameBuffer frame(cout, 1, async_writer.get());
         rlutil::CursorHider cursor_hider;
 #ifndef NIM_USE_DEFAULT_FONT_COLOR
         rlutil::setColor(rlutil::WHITE);
@@ -384,56 +687,44 @@ namespace nim
 
         detail::WordWrapSetUp();
 
-        cout << "  Welcome to the interactive NIM. Type 'how2play' for instructions and rules.\n"
-                "  Type 'help' for detailed help.\n";
+        cout << WELCOME_TEXT;
 
         do
         {
             detail::NimConsole console(m_impl);
             game.Console = &console;
-            cout << "  Would you like to play against a CPU or a human? {cpu|human}" << "\n";
+            cout << OPPONENT_QUESTION;
+            auto choice = detail::OpponentChoice::None;
             do
             {
                 cout << "> ";
                 string in;
-                getline(cin, in);
-                stringstream ss(in);
-                if (ss >> in)
+                if (!read_line(in))
                 {
-                    detail::lowercase(in);
-                    if (in == "exit" || in == "rq")
-                    {
-                        game.Quit = true;
-                        console.quit();
-                        return 0;
-                    }
-                    string dummy;
-                    if (ss >> dummy)
-                    {
-                        cout << detail::print_err(ERR_ARGUMENT) << "Expected only 1 argument, one of {cpu,human}.\n";
-                        continue;
-                    }
-                    if (in == "human")
-                    {
-                        game.CPU = false;
-                    }
-                    else if (in == "cpu")
-                    {
-                        game.CPU = true;
-                    }
-                    else
-                    {
-                        cout << detail::print_err(ERR_ARGUMENT) << "Expected one of {cpu,human}. Got '" << in << "'.\n";
-                        continue;
-                    }
-                    break;
+                    // out of input: nobody left to answer
+                    cout << "\n";
+                    return 0;
+                }
+                choice = detail::ChooseOpponent(game, detail::StringView(in.data(), in.size()));
+                if (choice == detail::OpponentChoice::Exit)
+                {
+                    game.Quit = true;
+                    console.quit();
+                    return 0;
                 }
-            } while (true);
+            } while (choice != detail::OpponentChoice::Chosen);
 
             cout << "----\n";
 
             game.StartTurn();
-            console.run();
+            if (!script)
+            {
+                console.run();
+            }
+            else if (!console.RunScript(*script))
+            {
+                return 0;
+            }
 
             game.Rnd();
 
@@ -465,66 +756,66 @@ namespace nim
     namespace detail
     {
 
-        static void PrintHelpForCmd(const ConsoleCmdDesc& desc_item)
+        static void PrintHelpForCmd(ostream& out, const ConsoleCmdDesc& desc_item)
         {
-            cout << "  " << desc_item.Syntax;
+            out << "  " << desc_item.Syntax;
             auto syntax_len = (desc_item.Syntax.length() + 2) % CONSOLE_WIDTH;
             if (syntax_len >= (CONSOLE_WIDTH - DESCRIPTION_WIDTH - 1))
             {
                 syntax_len = 0;
-                cout << "\n";
+                out << "\n";
             }
             const auto& desc_lines = desc_item.Description;
             for (const auto& line : desc_lines)
             {
-                cout << setw((CONSOLE_WIDTH - 1 - syntax_len)) << line << "\n";
+                out << setw((CONSOLE_WIDTH - 1 - syntax_len)) << line << "\n";
                 syntax_len = 0;
             }
-            cout << "\n";
+            out << "\n";
         }
 
-        static void CmdHelp(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdHelp(NimImpl* nimpl, const Args& parts)
         {
-            cout << right;
+            auto& out = *nimpl->Out;
+            out << right;
             auto arg_count = parts.size();
             if (arg_count == 1)
             {
                 for (const auto& elem : ConsoleCmdDescs)
                 {
-                    PrintHelpForCmd(elem.second);
+                    PrintHelpForCmd(out, elem.second);
                 }
             }
             else
             {
                 if (arg_count == 2)
                 {
-                    auto arg = parts[1];
-                    lowercase(arg);
-                    if (arg == "me")
+                    if (EqualsIgnoreCase(parts[1], "me"))
                     {
-                        cout << "  You're on your own buddy.\n";
+                        out << "  You're on your own buddy.\n";
                         return;
                     }
                 }
                 for (auto i = unsigned(1); i < arg_count; ++i)
                 {
-                    auto arg = parts[i];
+                    auto arg = parts[i].Str();
                     lowercase(arg);
                     auto search = ConsoleCmdDescs.find(arg);
                     if (search == ConsoleCmdDescs.end())
                     {
-                        cout << print_err(ERR_SYNTAX) << "  Command '" << arg << "' not found\n";
+                        out << print_err(ERR_SYNTAX) << "  Command '" << arg << "' not found\n";
                     }
                     else
                     {
-                        PrintHelpForCmd(search->second);
+                        PrintHelpForCmd(out, search->second);
                     }
                 }
             }
         }
 
-        static void CmdShow(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdShow(NimImpl* nimpl, const Args& parts)
         {
+            auto& out = *nimpl->Out;
             auto arg_count = parts.size();
             if (arg_count == 1)
             {
@@ -536,207 +827,270 @@ namespace nim
             {
                 const auto& arg = parts[i];
                 int32 val;
-                using namespace numerics;
-                if (!parse_integral<int32>(arg.c_str(), &val))
+                if (!parse_token(arg, &val))
                 {
-                    cout << print_err(ERR_ARGUMENT) << "Could not parse '" << arg << "' as an integer.\n";
+                    out << print_err(ERR_ARGUMENT) << "Could not parse '" << arg << "' as an integer.\n";
                     return;
                 }
-                if (val < 1 || val > 3)
+                if (val < 1 || val > nimpl->PileCount())
                 {
-                    cout << print_err(ERR_RANGE) << "Expected <pile> in range [1, 3], got '" << val << "'.\n";
+                    out << print_err(ERR_RANGE) << "Expected <pile> in range [1, " << nimpl->PileCount() << "], got '" << val << "'.\n";
                     return;
                 }
-                output_stream << nimpl->Piles[val - 1] << "  ";
+                output_stream << nimpl->GetPile(val - 1) << "  ";
             }
             auto output = output_stream.str();
-            cout << "  " << output.substr(0, output.length() - 2) << "\n";
+            out << "  " << output.substr(0, output.length() - 2) << "\n";
         }
 
-        static void CmdTake(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdTake(NimImpl* nimpl, const Args& parts)
         {
+            auto& out = *nimpl->Out;
             auto arg_count = parts.size();
             if (arg_count == 1)
             {
-                cout << print_err(ERR_ARGUMENT) << "Arguments <number> AND <pile> not found. Type 'help take' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Arguments <number> AND <pile> not found. Type 'help take' for usage details.\n";
                 return;
             }
             else if (arg_count == 2)
             {
-                cout << print_err(ERR_ARGUMENT) << "Argument <pile> not found. Type 'help take' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Argument <pile> not found. Type 'help take' for usage details.\n";
                 return;
             }
-            auto parts2 = parts[2];
-            lowercase(parts2);
-            auto has_from = (parts2 == "from");
+            auto has_from = EqualsIgnoreCase(parts[2], "from");
             if (arg_count >= uint32(4 + (has_from ? 1 : 0)))
             {
-                cout << print_err(ERR_ARGUMENT) << "Too many arguments. Type 'help take' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Too many arguments. Type 'help take' for usage details.\n";
                 return;
             }
             if (has_from && (arg_count == 3))
             {
-                cout << print_err(ERR_ARGUMENT) << "Argument <pile> not found. Type 'help take' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Argument <pile> not found. Type 'help take' for usage details.\n";
                 return;
             }
 
             int32 number;
             int32 pile_index;
-            using namespace numerics;
 
-            if (!parse_integral<int32>(parts[1].c_str(), &number))
+            if (!parse_token(parts[1], &number))
             {
-                cout << print_err(ERR_ARGUMENT) << "Could not parse '" << parts[1] << "' as an integer.\n";
+                out << print_err(ERR_ARGUMENT) << "Could not parse '" << parts[1] << "' as an integer.\n";
                 return;
             }
             const auto& pile_string = (has_from ? parts[3] : parts[2]);
-            if (!parse_integral<int32>(pile_string.c_str(), &pile_index))
-            {
-                cout << print_err(ERR_ARGUMENT) << "Could not parse '" << pile_string << "' as an integer.\n";
-                return;
-            }
-
-            if (pile_index < 1 || pile_index > 3)
+            if (!parse_token(pile_string, &pile_index))
             {
-                cout << print_err(ERR_RANGE) << "Expected <pile> in range [1, 3], got '" << pile_index << "'.\n";
+                out << print_err(ERR_ARGUMENT) << "Could not parse '" << pile_string << "' as an integer.\n";
                 return;
             }
 
-            auto& pile = nimpl->Piles[pile_index - 1];
-
-            if (pile == 0)
-            {
-                cout << print_err(ERR_RANGE) << "Pile " << pile_index << " is empty.\n";
-                return;
-            }
-            else if (number < 1 || number > pile)
+            switch (nimpl->Take(number, pile_index - 1))
             {
-                cout << print_err(ERR_RANGE) << "Expected <number> in range [1, pile length (" << int32(pile) << ")], got '" << number << "'.\n";
-                return;
+                case TakeResult::Ok:
+                    break;
+                case TakeResult::PileRange:
+                    out << print_err(ERR_RANGE) << "Expected <pile> in range [1, " << nimpl->PileCount() << "], got '" << pile_index << "'.\n";
+                    return;
+                case TakeResult::PileEmpty:
+                    out << print_err(ERR_RANGE) << "Pile " << pile_index << " is empty.\n";
+                    return;
+                case TakeResult::NumberRange:
+                    out << print_err(ERR_RANGE) << "Expected <number> in range [1, pile length (" << int32(nimpl->GetPile(pile_index - 1)) << ")], got '" << number << "'.\n";
+                    return;
             }
 
-            pile -= number;
-
+            ++nimpl->Moves;
             nimpl->NextTurn();
         }
 
-        static void CmdName(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdName(NimImpl* nimpl, const Args& parts)
         {
+            auto& out = *nimpl->Out;
             auto arg_count = parts.size();
             if (arg_count == 1)
             {
-                cout << print_err(ERR_ARGUMENT) << "Argument <name> not found. Type 'help name' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Argument <name> not found. Type 'help name' for usage details.\n";
                 return;
             }
             string name;
             for (auto i = unsigned(1); i < arg_count; ++i)
             {
-                name += parts[i] + " ";
+                name.append(parts[i].Data, parts[i].Size);
+                name += " ";
             }
             nimpl->SetCurrentPlayerName(name.substr(0, name.length() - 1));
             nimpl->UpdatePrompt();
         }
 
-        static void CmdHow2Play(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdHow2Play(NimImpl* nimpl, const Args& parts)
         {
+            auto& out = *nimpl->Out;
             static const string HOW2PLAY = 
                 #include "how2play.txt"
             ;
-            cout << HOW2PLAY << "\n";
+            out << HOW2PLAY << "\n";
         }
 
-        static void CmdRestart(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdRestart(NimImpl* nimpl, const Args& parts)
         {
+            auto& out = *nimpl->Out;
             auto arg_count = parts.size();
-            if (arg_count == 1) { cout << "\n"; nimpl->Console->quit(); return; }
+            if (arg_count == 1) { out << "\n"; nimpl->Console->quit(); return; }
             if (arg_count > 2)
             {
-                cout << print_err(ERR_ARGUMENT) << "Expected only 1 argument, one of {cpu,human}.\n";
+                out << print_err(ERR_ARGUMENT) << "Expected only 1 argument, one of {cpu,human}.\n";
                 return;
             }
-            auto opponent_type = parts[1];
-            lowercase(opponent_type);
-            if (opponent_type == "human")
+            const auto& opponent_type = parts[1];
+            if (EqualsIgnoreCase(opponent_type, "human"))
             {
                 nimpl->CPU = false;
             }
-            else if (opponent_type == "cpu")
+            else if (EqualsIgnoreCase(opponent_type, "cpu"))
             {
                 nimpl->CPU = true;
             }
             else
             {
-                cout << detail::print_err(ERR_ARGUMENT) << "Expected one of {cpu,human}. Got '" << opponent_type << "'.\n";
+                out << detail::print_err(ERR_ARGUMENT) << "Expected one of {cpu,human}. Got '" << LowerCase{ opponent_type } << "'.\n";
                 return;
             }
-            cout << "----\n";
+            out << "----\n";
             nimpl->Restart();
         }
 
-        static void CmdExit(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdExit(NimImpl* nimpl, const Args& parts)
         {
             nimpl->Console->quit();
             nimpl->Quit = true;
         }
 
-        static void CmdRq(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdRq(NimImpl* nimpl, const Args& parts)
         {
             CmdExit(nimpl, parts);
         }
 
-        static void CmdColor(NimImpl* nimpl, const vector<string>& parts)
+        static void CmdColor(NimImpl* nimpl, const Args& parts)
         {
+            auto& out = *nimpl->Out;
             auto arg_count = parts.size();
             if (arg_count == 1)
             {
-                cout << print_err(ERR_ARGUMENT) << "Argument <color> not found. Type 'help color' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Argument <color> not found. Type 'help color' for usage details.\n";
                 return;
             }
             else if (arg_count > 2)
             {
-                cout << print_err(ERR_ARGUMENT) << "Too many arguments. Type 'help take' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Too many arguments. Type 'help take' for usage details.\n";
                 return;
             }
-            auto color_name = parts[1];
+            auto color_name = parts[1].Str();
             lowercase(color_name);
             auto search = ColorsMap.find(color_name);
             if (search == ColorsMap.end())
             {
-                cout << print_err(ERR_ARGUMENT) << "Could not find color named '" << color_name << "'. Type 'help color' for usage details.\n";
+                out << print_err(ERR_ARGUMENT) << "Could not find color named '" << color_name << "'. Type 'help color' for usage details.\n";
                 return;
             }
-            rlutil::setColor(search->second);
+            if (nimpl->Out == &cout)
+            {
+                rlutil::setColor(search->second);
+            }
+            else
+            {
+                out << rlutil::getANSIColor(search->second);
+            }
         }
 
+        // The <file> argument of save and load, false after reporting why
+        // there is none to use
+        static bool FileArgument(NimImpl* nimpl, const Args& parts, const char* command)
+        {
+            auto& out = *nimpl->Out;
+            if (!nimpl->FileCommands)
+            {
+                out << print_err(ERR_GENERIC) << "Games cannot be saved or loaded here.\n";
+                return false;
+            }
+            if (parts.size() == 1)
+            {
+                out << print_err(ERR_ARGUMENT) << "Argument <file> not found. Type 'help " << command << "' for usage details.\n";
+                return false;
+            }
+            if (parts.size() > 2)
+            {
+                out << print_err(ERR_ARGUMENT) << "Too many arguments. Type 'help " << command << "' for usage details.\n";
+                return false;
+            }
+            return true;
+        }
 
-
-
-        // Utils implementation
-
-        template <typename T>
-        static vector<T>& split(const T& s, vector<T>& elems)
+        static void CmdSave(NimImpl* nimpl, const Args& parts)
         {
-            basic_stringstream<typename T::value_type> ss(s);
-            T item;
-            while (ss >> item) {
-                elems.push_back(item);
+            auto& out = *nimpl->Out;
+            if (!FileArgument(nimpl, parts, "save")) { return; }
+            auto path = parts[1].Str();
+            string snapshot;
+            nimpl->Save(snapshot);
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file.write(snapshot.data(), std::streamsize(snapshot.size())) || !file.flush())
+            {
+                out << print_err(ERR_GENERIC) << "Could not write '" << path << "'.\n";
+                return;
             }
-            return elems;
+            out << "  Saved the game to '" << path << "'.\n";
         }
 
-        template <typename T>
-        static vector<T> split(const T& s)
+        static void CmdLoad(NimImpl* nimpl, const Args& parts)
         {
-            vector<T> elems;
-            split<T>(s, elems);
-            return move(elems);
+            auto& out = *nimpl->Out;
+            if (!FileArgument(nimpl, parts, "load")) { return; }
+            auto path = parts[1].Str();
+            std::ifstream file(path, std::ios::binary);
+            std::ostringstream contents;
+            if (!file || !(contents << file.rdbuf()))
+            {
+                out << print_err(ERR_GENERIC) << "Could not read '" << path << "'.\n";
+                return;
+            }
+            auto snapshot = contents.str();
+            switch (nimpl->Load(snapshot.data(), snapshot.size()))
+            {
+                case RestoreResult::Ok:
+                    break;
+                case RestoreResult::Version:
+                    out << print_err(ERR_GENERIC) << "'" << path << "' was saved by an incompatible version of the game.\n";
+                    return;
+                case RestoreResult::Finished:
+                    out << print_err(ERR_GENERIC) << "The game saved in '" << path << "' is already over.\n";
+                    return;
+                case RestoreResult::Malformed:
+                case RestoreResult::UnknownName:
+                    out << print_err(ERR_GENERIC) << "'" << path << "' is not a saved game, or is damaged.\n";
+                    return;
+            }
+            out << "  Loaded the game from '" << path << "'.\n----\n";
+            nimpl->StartTurn();
         }
 
+
+
+
+        // Utils implementation
+
         static void lowercase(string& s)
         {
             transform(s.begin(), s.end(), s.begin(), ::tolower);
         }
 
+        static bool parse_token(const StringView& token, int32* value)
+        {
+            using namespace numerics;
+            auto last = token.Data + token.Size;
+            auto result = from_chars(token.Data, last, *value);
+            return result.ec == parse_errc::ok && result.ptr == last;
+        }
+
         static vector<string> word_wrap_fill(const string& text, size_t line_length)
         {
             stringstream words(text);
@@ -777,7 +1131,7 @@ namespace nim
                 }
                 lines.push_back(str);
             }
-            return move(lines);
+            return lines;
         }
 
         static string print_err(const string& err_type)
@@ -785,121 +1139,877 @@ namespace nim
             return "> " + err_type + ": ";
         }
 
-        static void WordWrapSetUp()
+        static bool ParseOptions(const vector<string>& args, Options& options)
         {
-            for (auto& cmd_desc : ConsoleCmdDescs)
+            using namespace numerics;
+            for (size_t i = 0; i < args.size(); ++i)
             {
-                auto& desc = cmd_desc.second;
-                desc.Description = move(word_wrap_fill(desc.Description[0], DESCRIPTION_WIDTH));
-            }
-        }
-
-
-
-
-        // Pile implementation
-
-        Pile& Pile::operator =(int32 new_count)
-        {
-            NIM_ASSERT(new_count >= 0);
-            count = new_count;
-            return *this;
-        }
-
-        Pile& Pile::operator =(const Pile& other)
-        {
-            count = other.count;
-            return *this;
-        }
-
-        Pile& Pile::operator --()
-        {
-            --count;
-            NIM_ASSERT(count >= 0);
-            return *this;
-        }
-
-        Pile& Pile::operator ++()
-        {
-            ++count;
-            NIM_ASSERT(count <= PILE_MAX);
-            return *this;
-        }
-
-        Pile Pile::operator --(int32)
-        {
-            Pile p{ count };
-            --count;
-            NIM_ASSERT(count >= 0);
-            return move(p);
+                const auto& arg = args[i];
+                auto has_value = (i + 1 < args.size());
+                if (arg == "--piles")
+                {
+                    if (!has_value || !parse_integral<int32>(args[++i].c_str(), &options.PileCount) || options.PileCount < 1)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --piles <count> with <count> of at least 1.\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--simulate")
+                {
+                    if (!has_value || !parse_integral<int64>(args[++i].c_str(), &options.SimulateGames) || options.SimulateGames < 1)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --simulate <games> with <games> of at least 1.\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--threads")
+                {
+                    if (!has_value || !parse_integral<int32>(args[++i].c_str(), &options.Threads) || options.Threads < 0)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --threads <count> with <count> of at least 0 (0 for one per core).\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--script")
+                {
+                    if (!has_value)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --script <file>.\n";
+                        return false;
+                    }
+                    options.ScriptPath = args[++i];
+                }
+                else if (arg == "--seed")
+                {
+                    if (!has_value || !parse_integral<uint64>(args[++i].c_str(), &options.Seed))
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --seed <seed> with an integer <seed>.\n";
+                        return false;
+                    }
+                    options.HasSeed = true;
+                }
+                else if (arg == "--serve")
+                {
+                    if (!has_value || !parse_integral<int32>(args[++i].c_str(), &options.ServePort) || options.ServePort < 0 || options.ServePort > 65535)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --serve <port> with <port> in range [0, 65535].\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--stats")
+                {
+                    if (!has_value || !parse_integral<int32>(args[++i].c_str(), &options.StatsInterval) || options.StatsInterval < 0)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --stats <seconds> with <seconds> of at least 0 (0 for no reports).\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--io")
+                {
+                    string backend = has_value ? args[++i] : "";
+                    lowercase(backend);
+                    if (backend == "uring")
+                    {
+                        options.UseUring = true;
+                    }
+                    else if (backend == "epoll")
+                    {
+                        options.UseUring = false;
+                    }
+                    else
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --io <uring|epoll>.\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--bind")
+                {
+                    if (!has_value)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --bind <address>.\n";
+                        return false;
+                    }
+                    options.BindAddress = args[++i];
+                }
+                else if (arg == "--shm")
+                {
+                    if (!has_value || args[i + 1].empty() || args[i + 1].find('/') != string::npos)
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --shm <name> with a <name> without slashes.\n";
+                        return false;
+                    }
+                    options.ShmName = args[++i];
+                }
+                else if (arg == "--protocol")
+                {
+                    string protocol = has_value ? args[++i] : "";
+                    lowercase(protocol);
+                    if (protocol == "text")
+                    {
+                        options.JsonLines = false;
+                    }
+                    else if (protocol == "jsonl")
+                    {
+                        options.JsonLines = true;
+                    }
+                    else
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --protocol <text|jsonl>.\n";
+                        return false;
+                    }
+                }
+                else if (arg == "--async-output")
+                {
+                    options.AsyncOutput = true;
+                }
+                else if (arg == "--opponent")
+                {
+                    string opponent = has_value ? args[++i] : "";
+                    lowercase(opponent);
+                    if (opponent == "cpu")
+                    {
+                        options.SimulateOpponent = Opponent::CPU;
+                    }
+                    else if (opponent == "random")
+                    {
+                        options.SimulateOpponent = Opponent::Random;
+                    }
+                    else
+                    {
+                        cout << print_err(ERR_ARGUMENT) << "Expected --opponent <opponent> with <opponent> one of {cpu,random}.\n";
+                        return false;
+                    }
+                }
+                else
+                {
+                    cout << print_err(ERR_ARGUMENT) << "Unknown option '" << arg << "'.\n";
+                    return false;
+                }
+            }
+            return true;
         }
 
-        Pile Pile::operator ++(int32)
+        static int OpenScript(const string& path)
         {
-            Pile p{ count };
-            ++count;
-            NIM_ASSERT(count <= PILE_MAX);
-            return move(p);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+            return ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+            return ::open(path.c_str(), O_RDONLY);
+#endif
         }
 
-        Pile& Pile::operator -=(int32 diff)
+        ScriptCloser::~ScriptCloser()
         {
-            count -= diff;
-            NIM_ASSERT(count >= 0 && count <= PILE_MAX);
-            return *this;
+            // stdin stays open
+            if (Fd > 0)
+            {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+                ::_close(Fd);
+#else
+                ::close(Fd);
+#endif
+            }
         }
 
-        Pile& Pile::operator -=(const Pile& other)
+        static void RunSimulation(const Options& options)
         {
-            return *this -= other.count;
+            SimulationOptions sim;
+            sim.Games = uint64(options.SimulateGames);
+            sim.PileCount = options.PileCount;
+            sim.Player2 = options.SimulateOpponent;
+            sim.Seed = options.Seed;
+
+            ThreadPool pool(size_t(options.Threads));
+            auto stats = Simulate(sim, &pool);
+
+            auto games = double(stats.Games);
+            auto seconds = std::max(stats.Seconds, 1e-9);
+            auto percent = [games](uint64 n) { return 100.0 * double(n) / games; };
+
+            cout << std::fixed << std::setprecision(2)
+                 << "  Simulated " << stats.Games << " games of " << sim.PileCount << " piles, cpu vs "
+                 << (sim.Player2 == Opponent::CPU ? "cpu" : "random") << ", on " << pool.ThreadCount() << " threads, seed " << sim.Seed << ".\n"
+                 << "  Time:              " << stats.Seconds << " s\n"
+                 << "  Games/sec:         " << games / seconds << "\n"
+                 << "  Moves/sec:         " << double(stats.Moves) / seconds << "\n"
+                 << "  Moves/game:        " << double(stats.Moves) / games << "\n"
+                 << "  Player 1 (cpu):    " << percent(stats.Player1Wins) << "% won\n"
+                 << "  Player 2:          " << percent(stats.Games - stats.Player1Wins) << "% won\n"
+                 << "  First mover:       " << percent(stats.FirstMoverWins) << "% won\n"
+                 << "  Winning starts:    " << percent(stats.WinningStarts) << "% of games\n";
         }
 
-        Pile& Pile::operator +=(int32 diff)
+        // Play for programs rather than people, behind the machine
+        // protocols: a headless game where the client is player 1, and
+        // player 2 the CPU, or, against a human, the same client moving in
+        // turn. The CPU answers a move right away.
+        struct BotGame : public Game
         {
-            count += diff;
-            NIM_ASSERT(count >= 0 && count <= PILE_MAX);
-            return *this;
-        }
+            // Most piles a restart can ask for
+            static const int32 MAX_PILES = 1 << 16;
 
-        Pile& Pile::operator +=(const Pile& other)
+            BotGame(const Options& options, uint64 stream)
+            {
+                Seed(options.Seed, stream);
+                Resize(options.PileCount);
+                CPU = true;
+                NewGame();
+            }
+
+            // Starts over on the position as it is set up now, which has to
+            // have chips left: an empty one has no player to win it
+            void NewGame()
+            {
+                DecideTurn();
+                Over = false;
+                Winner = 0;
+                CPUTurn();
+            }
+
+            // A move by the player to move; pile counts from 0
+            TakeResult Play(int32 number, int32 pile)
+            {
+                auto result = Take(number, pile);
+                if (result == TakeResult::Ok)
+                {
+                    ++Moves;
+                    Next();
+                }
+                return result;
+            }
+
+            bool Over = false;
+            int32 Winner = 0;       // 1 or 2, once over
+            bool CPUMoved = false;  // since the front-end last cleared it
+            Move CPUMoveMade;
+            uint64 Moves = 0;
+
+        private:
+            // Ends the game or passes the turn after a move
+            void Next()
+            {
+                if (GameOver())
+                {
+                    Over = true;
+                    Winner = Player1Turn ? 1 : 2;
+                    return;
+                }
+                SwitchTurn();
+                CPUTurn();
+            }
+
+            void CPUTurn()
+            {
+                if (!CPU || Player1Turn) { return; }
+                CPUMoveMade = CPUMove();
+                if (Take(CPUMoveMade.Number, CPUMoveMade.Pile) != TakeResult::Ok) { return; }
+                CPUMoved = true;
+                ++Moves;
+                Next();
+            }
+        };
+
+        // The JSON-lines protocol: one JSON request per line, one JSON reply
+        // line per request, carrying the position and the turn as fields
+        // instead of console text.
+        //
+        //   {"id":1,"op":"move","pile":2,"count":3}
+        //   {"id":1,"ok":true,"piles":[4,1,6],"turn":1,"opponent":"cpu","over":false,"cpu_move":{"pile":1,"count":2}}
+        class JsonSession
         {
-            return *this += other.count;
-        }
+        public:
+            JsonSession(const Options& options, uint64 stream) : game(options, stream) {}
 
-        bool Pile::operator ==(int32 other_count) const
+            // Handles one request line, appending its reply line to out
+            void Execute(const StringView& line, string& out)
+            {
+                JsonWriter reply(out);
+                game.CPUMoved = false;
+                if (!request.Parse(line))
+                {
+                    Fail(reply, nullptr, "syntax", "Expected a JSON object.");
+                }
+                else
+                {
+                    auto id = request.Find("id");
+                    auto op = request.Find("op");
+                    if (!op || op->Kind != JsonValue::Type::String)
+                    {
+                        Fail(reply, id, "argument", "Expected \"op\", one of {move,show,restart,analyze}.");
+                    }
+                    else if (EqualsIgnoreCase(op->String, "move"))
+                    {
+                        MakeMove(reply, id);
+                    }
+                    else if (EqualsIgnoreCase(op->String, "show"))
+                    {
+                        Succeed(reply, id);
+                        State(reply);
+                    }
+                    else if (EqualsIgnoreCase(op->String, "restart"))
+                    {
+                        Restart(reply, id);
+                    }
+                    else if (EqualsIgnoreCase(op->String, "analyze"))
+                    {
+                        Analyze(reply, id);
+                    }
+                    else
+                    {
+                        Fail(reply, id, "unknown_op", "Unknown op '" + op->String.Str() + "'.");
+                    }
+                }
+                reply.End();
+                out.push_back('\n');
+            }
+
+            uint64 Moves() const
+            {
+                return game.Moves;
+            }
+
+        private:
+            void MakeMove(JsonWriter& reply, const JsonValue* id)
+            {
+                int32 pile, count;
+                if (game.Over)
+                {
+                    return Fail(reply, id, "over", "The game is over. Send a restart.");
+                }
+                auto pile_value = Integer("pile", pile);
+                auto count_value = Integer("count", count);
+                if (!pile_value || !count_value)
+                {
+                    return Fail(reply, id, "argument", "Expected integers \"pile\" and \"count\".");
+                }
+                switch (game.Play(count, pile - 1))
+                {
+                    case TakeResult::Ok:
+                        break;
+                    case TakeResult::PileRange:
+                        return Fail(reply, id, "range", "Expected \"pile\" in range [1, " + std::to_string(game.PileCount()) + "], got " + pile_value->Raw.Str() + ".");
+                    case TakeResult::PileEmpty:
+                        return Fail(reply, id, "range", "Pile " + std::to_string(pile) + " is empty.");
+                    case TakeResult::NumberRange:
+                        return Fail(reply, id, "range", "Expected \"count\" in range [1, pile length (" + std::to_string(int32(game.GetPile(pile - 1))) + ")], got " + count_value->Raw.Str() + ".");
+                }
+                Succeed(reply, id);
+                State(reply);
+            }
+
+            // "opponent" switches between cpu and human; "piles" is a new pile
+            // count, or the exact piles to play
+            void Restart(JsonWriter& reply, const JsonValue* id)
+            {
+                auto opponent = request.Find("opponent");
+                auto cpu = game.CPU;
+                if (opponent)
+                {
+                    if (opponent->Kind == JsonValue::Type::String && EqualsIgnoreCase(opponent->String, "cpu"))
+                    {
+                        cpu = true;
+                    }
+                    else if (opponent->Kind == JsonValue::Type::String && EqualsIgnoreCase(opponent->String, "human"))
+                    {
+                        cpu = false;
+                    }
+                    else
+                    {
+                        return Fail(reply, id, "argument", "Expected \"opponent\", one of {cpu,human}.");
+                    }
+                }
+                auto piles = request.Find("piles");
+                if (piles && piles->Kind == JsonValue::Type::Array)
+                {
+                    counts.clear();
+                    auto chips = false;
+                    for (size_t i = 0; i < piles->Count; ++i)
+                    {
+                        auto& element = request.Element(*piles, i);
+                        if (!element.Integer)
+                        {
+                            return Fail(reply, id, "argument", "Expected pile lengths as integers, got " + element.Raw.Str() + ".");
+                        }
+                        auto count = element.Number;
+                        if (count < 0 || count > std::numeric_limits<int32>::max())
+                        {
+                            return Fail(reply, id, "range", "Expected pile lengths in range [0, " + std::to_string(std::numeric_limits<int32>::max()) + "].");
+                        }
+                        counts.push_back(int32(count));
+                        chips = chips || count != 0;
+                    }
+                    if (counts.empty() || counts.size() > size_t(BotGame::MAX_PILES))
+                    {
+                        return Fail(reply, id, "range", "Expected from 1 to " + std::to_string(BotGame::MAX_PILES) + " piles.");
+                    }
+                    // like a finished snapshot, there is no game left to play
+                    if (!chips)
+                    {
+                        return Fail(reply, id, "range", "Expected at least one pile with chips in it.");
+                    }
+                    game.SetPiles(counts.data(), int32(counts.size()));
+                }
+                else if (piles)
+                {
+                    if (piles->Kind == JsonValue::Type::Number && !piles->Integer)
+                    {
+                        return Fail(reply, id, "argument", "Expected \"piles\" as a whole count, got " + piles->Raw.Str() + ".");
+                    }
+                    if (piles->Kind != JsonValue::Type::Number || piles->Number < 1 || piles->Number > BotGame::MAX_PILES)
+                    {
+                        return Fail(reply, id, "range", "Expected \"piles\" as a count in range [1, " + std::to_string(BotGame::MAX_PILES) + "], or an array of pile lengths.");
+                    }
+                    game.Resize(int32(piles->Number));
+                }
+                else
+                {
+                    game.Rnd();
+                }
+                game.CPU = cpu;
+                game.NewGame();
+                Succeed(reply, id);
+                State(reply);
+            }
+
+            // The nim-sum and the move the CPU would make for the player to
+            // move; a non-zero nim-sum means that player can force a win
+            void Analyze(JsonWriter& reply, const JsonValue* id)
+            {
+                Succeed(reply, id);
+                auto nim_sum = game.NimSum();
+                reply.Key("nim_sum").Int(nim_sum).Key("winning").Bool(!game.Over && nim_sum != 0);
+                if (!game.Over)
+                {
+                    auto best = game.CPUMove();
+                    reply.Key("best").Begin().Key("pile").Int(best.Pile + 1).Key("count").Int(best.Number).End();
+                }
+                State(reply);
+            }
+
+            // The member key if it is a whole number, null otherwise
+            const JsonValue* Integer(const StringView& key, int32& value) const
+            {
+                auto member = request.Find(key);
+                if (!member || member->Kind != JsonValue::Type::Number || !member->Integer) { return nullptr; }
+                // out of range of a pile is out of range of int32 alike; its
+                // lowest is left out so that pile - 1 cannot overflow
+                auto limit = int64(std::numeric_limits<int32>::max());
+                value = int32(std::max(std::min(member->Number, limit), -limit));
+                return member;
+            }
+
+            static void Succeed(JsonWriter& reply, const JsonValue* id)
+            {
+                reply.Begin();
+                if (id) { reply.Key("id").Raw(id->Raw); }
+                reply.Key("ok").Bool(true);
+            }
+
+            static void Fail(JsonWriter& reply, const JsonValue* id, const char* error, const string& message)
+            {
+                reply.Begin();
+                if (id) { reply.Key("id").Raw(id->Raw); }
+                reply.Key("ok").Bool(false)
+                     .Key("error").String(StringView(error, std::strlen(error)))
+                     .Key("message").String(StringView(message.data(), message.size()));
+            }
+
+            void State(JsonWriter& reply)
+            {
+                reply.Key("piles").BeginArray();
+                for (auto i = 0; i < game.PileCount(); ++i)
+                {
+                    reply.Int(int32(game.GetPile(i)));
+                }
+                reply.EndArray()
+                     .Key("turn").Int(game.Player1Turn ? 1 : 2)
+                     .Key("opponent").String(game.CPU ? StringView("cpu") : StringView("human"))
+                     .Key("over").Bool(game.Over);
+                if (game.Over) { reply.Key("winner").Int(game.Winner); }
+                if (game.CPUMoved)
+                {
+                    reply.Key("cpu_move").Begin().Key("pile").Int(game.CPUMoveMade.Pile + 1).Key("count").Int(game.CPUMoveMade.Number).End();
+                }
+            }
+
+            BotGame game;
+            JsonObject request;
+            vector<int32> counts;
+        };
+
+#if defined(__linux__)
+        // Carries out one shared-memory request on game, filling in reply
+        static void ShmExecute(BotGame& game, const ShmRequest& request, ShmReply& reply)
         {
-            return count == other_count;
+            game.CPUMoved = false;
+            reply.Id = request.Id;
+            reply.Status = SHM_OK;
+            reply.NimSum = reply.BestPile = reply.BestCount = 0;
+            switch (request.Op)
+            {
+                case SHM_SHOW:
+                case SHM_CLOSE:
+                    break;
+                case SHM_MOVE:
+                    if (game.Over)
+                    {
+                        reply.Status = SHM_OVER;
+                    }
+                    else if (game.Play(request.Count, request.Pile - 1) != TakeResult::Ok)
+                    {
+                        reply.Status = SHM_RANGE;
+                    }
+                    break;
+                case SHM_RESTART:
+                    if (request.Pile < SHM_SAME || request.Pile > SHM_HUMAN || request.Count < 0 || request.Count > SHM_MAX_PILES)
+                    {
+                        reply.Status = SHM_RANGE;
+                        break;
+                    }
+                    if (request.Pile != SHM_SAME) { game.CPU = (request.Pile == SHM_CPU); }
+                    if (request.Count > 0)
+                    {
+                        game.Resize(request.Count);
+                    }
+                    else
+                    {
+                        game.Rnd();
+                    }
+                    game.NewGame();
+                    break;
+                case SHM_ANALYZE:
+                    reply.NimSum = game.NimSum();
+                    if (!game.Over)
+                    {
+                        auto best = game.CPUMove();
+                        reply.BestPile = best.Pile + 1;
+                        reply.BestCount = best.Number;
+                    }
+                    break;
+                default:
+                    reply.Status = SHM_UNKNOWN_OP;
+                    break;
+            }
+            reply.PileCount = game.PileCount();
+            for (auto i = 0; i < reply.PileCount; ++i)
+            {
+                reply.Piles[i] = int32(game.GetPile(i));
+            }
+            reply.Turn = uint8(game.Player1Turn ? 1 : 2);
+            reply.CPU = uint8(game.CPU);
+            reply.Over = uint8(game.Over);
+            reply.Winner = uint8(game.Winner);
+            reply.CPUPile = game.CPUMoved ? game.CPUMoveMade.Pile + 1 : 0;
+            reply.CPUCount = game.CPUMoved ? game.CPUMoveMade.Number : 0;
         }
+#endif
 
-        bool Pile::operator ==(const Pile& other) const
+        static int RunShm(const Options& options)
         {
-            return count == other.count;
+#if defined(__linux__)
+            if (options.PileCount > SHM_MAX_PILES)
+            {
+                cout << print_err(ERR_ARGUMENT) << "Expected --piles <count> of at most " << SHM_MAX_PILES << " with --shm.\n";
+                return 1;
+            }
+            ShmChannel channel;
+            if (!channel.Create(options.ShmName))
+            {
+                cout << print_err(ERR_GENERIC) << "Could not create " << ShmChannel::PathOf(options.ShmName) << ": " << std::strerror(errno) << ".\n";
+                return 1;
+            }
+            cout << "  Waiting on " << ShmChannel::PathOf(options.ShmName) << " (seed " << options.Seed << ")\n" << std::flush;
+
+            BotGame game(options, 0);
+            ShmRequest request;
+            ShmReply reply;
+            while (channel.Receive(request))
+            {
+                ShmExecute(game, request, reply);
+                if (!channel.Send(reply)) { break; }
+                if (request.Op == SHM_CLOSE) { return 0; }
+            }
+            cout << print_err(ERR_GENERIC) << "The client has gone away.\n";
+            return 1;
+#else
+            cout << print_err(ERR_GENERIC) << "Shared-memory channels need futexes, which this platform does not have.\n";
+            return 1;
+#endif
         }
 
-        int32 Pile::Count() const
+        static int RunJsonLines(const Options& options)
         {
-            return count;
+            int fd = 0;
+            if (!options.ScriptPath.empty())
+            {
+                fd = OpenScript(options.ScriptPath);
+                if (fd < 0)
+                {
+                    cout << print_err(ERR_ARGUMENT) << "Could not open script '" << options.ScriptPath << "'.\n";
+                    return 1;
+                }
+            }
+            ScriptCloser closer{ fd };
+            LineReader reader(fd);
+            JsonSession session(options, 0);
+
+            // replies collect while requests are already buffered, and go
+            // out with one write when the next one has to be waited for
+            string out;
+            out.reserve(FrameBuffer::FRAME_LIMIT);
+            StringView line;
+            while (reader.ReadLine(line))
+            {
+                if (!line.Empty())
+                {
+                    session.Execute(line, out);
+                }
+                if (out.size() >= FrameBuffer::FRAME_LIMIT || !reader.Buffered())
+                {
+                    if (!WriteAll(1, out.data(), out.size())) { return 1; }
+                    out.clear();
+                }
+            }
+            return WriteAll(1, out.data(), out.size()) ? 0 : 1;
         }
 
-        Pile::operator int32() const
+#if defined(__linux__)
+        // One network player: a game of their own, driven like the console
+        // but with whole lines in and replies appended to the connection
+        class GameSession : public ServerSession
+        {
+        public:
+            GameSession(const Options& options, uint64 stream, ServerStats& stats, string& greeting) : console(&game), out(&buffer), stats(stats)
+            {
+                game.Out = &out;
+                game.Console = &console;
+                game.FileCommands = false;
+                game.Player1Name = "player1";
+                game.Player2Name = "player2";
+                game.CPUName = "cpu";
+                game.Quit = false;
+                // every session its own sequence, all of them replayable
+                // from the one seed
+                game.Seed(options.Seed, stream);
+                game.Resize(options.PileCount);
+                game.DecideTurn();
+
+                buffer.Target = &greeting;
+                out << WELCOME_TEXT << OPPONENT_QUESTION << "> ";
+            }
+
+            virtual bool Execute(const StringView& line, string& reply) override
+            {
+                buffer.Target = &reply;
+                if (!playing)
+                {
+                    switch (ChooseOpponent(game, line))
+                    {
+                        case OpponentChoice::Exit:
+                            return false;
+                        case OpponentChoice::Chosen:
+                            playing = true;
+                            console.Resume();
+                            out << "----\n";
+                            game.StartTurn();
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                else
+                {
+                    auto moves = game.Moves;
+                    console.Execute(line);
+                    ServerStats::Increment(stats.Moves, game.Moves - moves);
+                }
+                if (playing && console.Quitting())
+                {
+                    if (game.Quit) { return false; }
+                    // game over, or a restart without an opponent
+                    playing = false;
+                    game.Rnd();
+                    out << OPPONENT_QUESTION;
+                }
+                out << (playing ? console.Prompt() : string("> "));
+                return true;
+            }
+
+        private:
+            NimImpl game;
+            NimConsole console;
+            AppendBuffer buffer;
+            ostream out;
+            ServerStats& stats;
+            bool playing = false;
+        };
+
+        // A network program speaking the JSON-lines protocol
+        class JsonGameSession : public ServerSession
+        {
+        public:
+            JsonGameSession(const Options& options, uint64 stream, ServerStats& stats) : session(options, stream), stats(stats) {}
+
+            virtual bool Execute(const StringView& line, string& reply) override
+            {
+                auto moves = session.Moves();
+                session.Execute(line, reply);
+                ServerStats::Increment(stats.Moves, session.Moves() - moves);
+                return true;
+            }
+
+        private:
+            JsonSession session;
+            ServerStats& stats;
+        };
+
+        // One event loop with its thread
+        struct ServerShard
         {
-            return count;
+            std::unique_ptr<Server> Loop;
+            uint64 Sessions = 0;
+            std::thread Thread;
+        };
+
+        // Waits for one of signals, printing each shard's connections and
+        // its command and move rates every interval seconds (0 for never)
+        // in the meantime
+        static void ReportShards(const vector<std::unique_ptr<ServerShard>>& shards, int32 interval, const sigset_t& signals)
+        {
+            vector<uint64> last_commands(shards.size()), last_moves(shards.size());
+            struct timespec timeout = { interval, 0 };
+            for (;;)
+            {
+                if (::sigtimedwait(&signals, nullptr, interval > 0 ? &timeout : nullptr) >= 0) { return; }
+                if (errno != EAGAIN) { continue; }
+                for (size_t i = 0; i < shards.size(); ++i)
+                {
+                    const auto& stats = shards[i]->Loop->Stats();
+                    auto accepted = stats.Accepted.load(std::memory_order_relaxed);
+                    auto closed = stats.Closed.load(std::memory_order_relaxed);
+                    auto commands = stats.Commands.load(std::memory_order_relaxed);
+                    auto moves = stats.Moves.load(std::memory_order_relaxed);
+                    cout << "  shard " << i << ": " << (accepted - closed) << " connections (" << accepted << " accepted), "
+                         << (commands - last_commands[i]) / uint64(interval) << " commands/s, "
+                         << (moves - last_moves[i]) / uint64(interval) << " moves/s\n";
+                    last_commands[i] = commands;
+                    last_moves[i] = moves;
+                }
+                cout << std::flush;
+            }
         }
+#endif
 
-        void Pile::Rnd()
+        // The CPUs this process may run on
+        static vector<int> AllowedCpus()
         {
-            count = PILE_MIN + static_cast<int>((::rand() % (PILE_MAX - PILE_MIN)));
+            vector<int> cpus;
+            cpu_set_t allowed;
+            if (::sched_getaffinity(0, sizeof allowed, &allowed) == 0)
+            {
+                for (auto cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                {
+                    if (CPU_ISSET(cpu, &allowed)) { cpus.push_back(cpu); }
+                }
+            }
+            return cpus;
         }
 
-        Pile::Pile()
+        static int RunServer(const Options& options)
         {
-            Rnd();
+#if defined(__linux__)
+            WordWrapSetUp();
+            RaiseFileLimit();
+
+            // one shard per core, each listening on the same port
+            auto cpus = AllowedCpus();
+            auto core_count = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : unsigned(cpus.size());
+            auto shard_count = size_t(options.Threads > 0 ? unsigned(options.Threads) : core_count);
+            vector<std::unique_ptr<ServerShard>> shards;
+            auto port = uint16(options.ServePort);
+            for (size_t i = 0; i < shard_count; ++i)
+            {
+                std::unique_ptr<ServerShard> shard(new ServerShard);
+                auto raw_shard = shard.get();
+                SessionFactory factory = [&options, raw_shard, i, shard_count](string& greeting)
+                {
+                    // session streams interleave over the shards, so no
+                    // two sessions share one
+                    auto stream = raw_shard->Sessions++ * shard_count + i;
+                    if (options.JsonLines)
+                    {
+                        return std::unique_ptr<ServerSession>(new JsonGameSession(options, stream, raw_shard->Loop->Stats()));
+                    }
+                    return std::unique_ptr<ServerSession>(new GameSession(options, stream, raw_shard->Loop->Stats(), greeting));
+                };
+                if (options.UseUring)
+                {
+                    shard->Loop = UringServer::Create(factory);
+                }
+                if (!shard->Loop)
+                {
+                    shard->Loop.reset(new EpollServer(factory));
+                }
+                if (!shard->Loop->Listen(options.BindAddress.c_str(), port, true))
+                {
+                    cout << print_err(ERR_GENERIC) << "Could not listen on " << options.BindAddress << ":" << port << ": " << std::strerror(errno) << ".\n";
+                    return 1;
+                }
+                // port 0 means the first shard's pick for the rest
+                port = shard->Loop->Port();
+                shards.push_back(std::move(shard));
+            }
+            cout << "  Serving on " << options.BindAddress << ":" << port << " with " << shard_count << " " << shards[0]->Loop->Backend()
+                 << " shard(s) (seed " << options.Seed << ")\n" << std::flush;
+
+            // SIGINT and SIGTERM are waited for below instead of handled;
+            // the loops' threads inherit the mask, so none of them takes one
+            sigset_t stop_signals;
+            sigemptyset(&stop_signals);
+            sigaddset(&stop_signals, SIGINT);
+            sigaddset(&stop_signals, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+            for (size_t i = 0; i < shard_count; ++i)
+            {
+                auto shard = shards[i].get();
+                shard->Thread = std::thread([shard] { shard->Loop->Run(); });
+                if (cpus.empty()) { continue; }
+                // keep each loop on a core of its own, with its sockets'
+                // data in that core's cache
+                cpu_set_t cpu;
+                CPU_ZERO(&cpu);
+                CPU_SET(cpus[i % cpus.size()], &cpu);
+                auto error = pthread_setaffinity_np(shard->Thread.native_handle(), sizeof cpu, &cpu);
+                if (error)
+                {
+                    cout << "  Shard " << i << " could not be kept on CPU " << cpus[i % cpus.size()] << ": " << std::strerror(error) << ".\n";
+                }
+            }
+            ReportShards(shards, options.StatsInterval, stop_signals);
+
+            // a second signal ends the process outright
+            pthread_sigmask(SIG_UNBLOCK, &stop_signals, nullptr);
+            cout << "  Stopping.\n" << std::flush;
+            for (auto& shard : shards)
+            {
+                shard->Loop->Stop();
+                shard->Thread.join();
+            }
+            return 0;
+#else
+            cout << print_err(ERR_GENERIC) << "Serving games needs epoll, which this platform does not have.\n";
+            return 1;
+#endif
         }
 
-        Pile::Pile(int32 new_count)
+        static void WordWrapSetUp()
         {
-            NIM_ASSERT(new_count >= 0 && new_count <= PILE_MAX);
-            count = new_count;
+            for (auto& cmd_desc : ConsoleCmdDescs)
+            {
+                auto& desc = cmd_desc.second;
+                desc.Description = move(word_wrap_fill(desc.Description[0], DESCRIPTION_WIDTH));
+            }
         }
 
     }
@@ -0,0 +1,101 @@
+/*
+ * command.hpp
+ *
+ * Allocation-free pieces of the console's command path: a non-owning view
+ * of part of the input line, a whitespace tokenizer producing such views,
+ * and ASCII case folding that compares in place instead of copying.
+ */
+
+#ifndef __nim_command_hpp__
+#define __nim_command_hpp__
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nim
+{
+    namespace detail
+    {
+        // Pointer and length into a string owned elsewhere (the input line or
+        // a literal). Only valid as long as that string is.
+        struct StringView
+        {
+            const char* Data;
+            size_t Size;
+
+            constexpr StringView() : Data(""), Size(0) {}
+            constexpr StringView(const char* data, size_t size) : Data(data), Size(size) {}
+            template <size_t N>
+            constexpr StringView(const char (&literal)[N]) : Data(literal), Size(N - 1) {}
+
+            bool Empty() const { return Size == 0; }
+            std::string Str() const { return std::string(Data, Size); }
+        };
+
+        inline std::ostream& operator <<(std::ostream& os, const StringView& view)
+        {
+            return os.write(view.Data, std::streamsize(view.Size));
+        }
+
+        constexpr char FoldCase(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+        }
+
+        inline bool EqualsIgnoreCase(const StringView& a, const StringView& b)
+        {
+            if (a.Size != b.Size) { return false; }
+            for (size_t i = 0; i < a.Size; ++i)
+            {
+                if (FoldCase(a.Data[i]) != FoldCase(b.Data[i])) { return false; }
+            }
+            return true;
+        }
+
+        // Prints a view lowercased, without making a lowercase copy
+        struct LowerCase
+        {
+            StringView Text;
+        };
+
+        inline std::ostream& operator <<(std::ostream& os, const LowerCase& lower)
+        {
+            for (size_t i = 0; i < lower.Text.Size; ++i)
+            {
+                os.put(FoldCase(lower.Text.Data[i]));
+            }
+            return os;
+        }
+
+        inline bool IsSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+        }
+
+        // Splits line on whitespace into views over line. tokens is cleared
+        // first but keeps its capacity, so a reused vector stops allocating
+        // once it has seen the longest command.
+        inline void Tokenize(const char* line, size_t length, std::vector<StringView>& tokens)
+        {
+            tokens.clear();
+            size_t i = 0;
+            for (;;)
+            {
+                while (i < length && IsSpace(line[i])) { ++i; }
+                if (i == length) { return; }
+                auto begin = i;
+                while (i < length && !IsSpace(line[i])) { ++i; }
+                tokens.push_back(StringView(line + begin, i - begin));
+            }
+        }
+
+        inline void Tokenize(const std::string& line, std::vector<StringView>& tokens)
+        {
+            Tokenize(line.data(), line.size(), tokens);
+        }
+    }
+}
+
+#endif /* __nim_command_hpp__ */
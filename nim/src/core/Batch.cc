@@ -0,0 +1,113 @@
+#include <nim/Batch.h>
+#include <nim/Position.h>
+#include <nim/Simd.h>
+
+// Positions with at least this many piles go through the SIMD kernels
+#define SIMD_MIN_PILES 64
+// Positions per chunk handed to a pool thread
+#define BATCH_GRAIN 4096
+
+namespace nim
+{
+    namespace
+    {
+        template <typename T>
+        void AnalyzePosition(const T* counts, size_t pile_count, size_t first_pile, const BatchOutput<T>& output, size_t i)
+        {
+            auto large = (pile_count >= SIMD_MIN_PILES);
+            auto sum = large ? simd::NimSum(counts, pile_count) : NimSum(counts, pile_count);
+            auto winning = (sum != 0);
+
+            if (output.Winning) { output.Winning[i] = uint8(winning); }
+            if (output.NimSums) { output.NimSums[i] = sum; }
+
+            if (output.MoveNumbers || output.MovePiles)
+            {
+                T number = 0;
+                int32 pile = -1;
+                if (winning)
+                {
+                    auto index = large ? simd::FindShrinkingPile(counts, pile_count, sum) : FindShrinkingPile(counts, pile_count, sum);
+                    number = T(counts[index] - (counts[index] ^ sum));
+                    pile = int32(index);
+                }
+                if (output.MoveNumbers) { output.MoveNumbers[i] = number; }
+                if (output.MovePiles) { output.MovePiles[i] = pile; }
+            }
+
+            if (output.WinningPiles || output.WinningNumbers || output.WinningCounts)
+            {
+                size_t found = 0;
+                if (winning && output.WinningPiles)
+                {
+                    auto piles = output.WinningPiles + first_pile;
+                    found = simd::FindShrinkingPiles(counts, pile_count, sum, piles, pile_count);
+                    if (output.WinningNumbers)
+                    {
+                        auto numbers = output.WinningNumbers + first_pile;
+                        for (size_t j = 0; j < found; ++j)
+                        {
+                            const auto& count = counts[piles[j]];
+                            numbers[j] = T(count - (count ^ sum));
+                        }
+                    }
+                }
+                else if (winning)
+                {
+                    // numbers only: one pass over the piles, no index array
+                    auto bit = HighestBitIndex(sum);
+                    for (size_t j = 0; j < pile_count; ++j)
+                    {
+                        if (BitOf(counts[j], bit))
+                        {
+                            if (output.WinningNumbers) { output.WinningNumbers[first_pile + found] = T(counts[j] - (counts[j] ^ sum)); }
+                            ++found;
+                        }
+                    }
+                }
+                if (output.WinningCounts) { output.WinningCounts[i] = found; }
+            }
+        }
+
+        template <typename T>
+        struct BatchRange
+        {
+            const BatchInput<T>& Input;
+            const BatchOutput<T>& Output;
+
+            void operator ()(size_t begin, size_t end) const
+            {
+                for (auto i = begin; i < end; ++i)
+                {
+                    size_t first = Input.Offsets ? Input.Offsets[i] : i * Input.PileCount;
+                    size_t count = Input.Offsets ? Input.Offsets[i + 1] - first : Input.PileCount;
+                    AnalyzePosition(Input.Counts + first, count, first, Output, i);
+                }
+            }
+        };
+
+        template <typename T>
+        void Analyze(const BatchInput<T>& input, const BatchOutput<T>& output, ThreadPool* pool)
+        {
+            BatchRange<T> range{ input, output };
+            if (pool)
+            {
+                pool->ParallelFor(input.PositionCount, BATCH_GRAIN, range);
+            }
+            else
+            {
+                range(0, input.PositionCount);
+            }
+        }
+    }
+
+    void AnalyzeBatch(const BatchInput<uint32>& input, const BatchOutput<uint32>& output, ThreadPool* pool)
+    {
+        Analyze(input, output, pool);
+    }
+
+    void AnalyzeBatch(const BatchInput<uint64>& input, const BatchOutput<uint64>& output, ThreadPool* pool)
+    {
+        Analyze(input, output, pool);
+    }
+}
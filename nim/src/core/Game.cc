@@ -0,0 +1,139 @@
+#include <nim/Game.h>
+#include <nim/nim_Assert.h>
+
+namespace nim
+{
+    Game::Game(int32 pile_count) :
+        Game(pile_count, EntropySeed())
+    {
+    }
+
+    Game::Game(int32 pile_count, uint64 seed) :
+        Player1Turn(true),
+        CPU(false),
+        Rng(seed)
+    {
+        Resize(pile_count);
+    }
+
+    void Game::Seed(uint64 seed, uint64 stream)
+    {
+        Rng.Seed(seed, stream);
+    }
+
+    Random& Game::GetRandom()
+    {
+        return Rng;
+    }
+
+    void Game::Resize(int32 pile_count)
+    {
+        NIM_ASSERT(pile_count > 0);
+        Piles.Resize(size_t(pile_count));
+        Rnd();
+    }
+
+    void Game::Rnd()
+    {
+        for (size_t i = 0; i < Piles.PileCount(); ++i)
+        {
+            Piles[i].Rnd(Rng);
+        }
+        Reindex();
+    }
+
+    void Game::DecideTurn()
+    {
+        Player1Turn = Rng.Coin();
+    }
+
+    void Game::SwitchTurn()
+    {
+        Player1Turn ^= true;
+    }
+
+    int32 Game::PileCount() const
+    {
+        return int32(Piles.PileCount());
+    }
+
+    const Pile& Game::GetPile(int32 index) const
+    {
+        NIM_ASSERT(index >= 0 && index < PileCount());
+        return Piles[size_t(index)];
+    }
+
+    const Position& Game::GetPosition() const
+    {
+        return Piles;
+    }
+
+    TakeResult Game::SetPile(int32 index, int32 count)
+    {
+        if (index < 0 || index >= PileCount()) { return TakeResult::PileRange; }
+        if (count < 0) { return TakeResult::NumberRange; }
+        auto& pile = Piles[size_t(index)];
+        auto old_count = pile.Count();
+        pile = count;
+        Index.Update(Piles.Data(), size_t(index), old_count);
+        return TakeResult::Ok;
+    }
+
+    TakeResult Game::SetPiles(const int32* counts, int32 pile_count)
+    {
+        if (pile_count < 1) { return TakeResult::PileRange; }
+        for (auto i = 0; i < pile_count; ++i)
+        {
+            if (counts[i] < 0) { return TakeResult::NumberRange; }
+        }
+        Piles.Resize(size_t(pile_count));
+        for (auto i = 0; i < pile_count; ++i)
+        {
+            Piles[size_t(i)] = counts[i];
+        }
+        Reindex();
+        return TakeResult::Ok;
+    }
+
+    TakeResult Game::CheckTake(int32 number, int32 pile) const
+    {
+        if (pile < 0 || pile >= PileCount()) { return TakeResult::PileRange; }
+        const auto& target = Piles[size_t(pile)];
+        if (target == 0) { return TakeResult::PileEmpty; }
+        if (number < 1 || number > target) { return TakeResult::NumberRange; }
+        return TakeResult::Ok;
+    }
+
+    TakeResult Game::Take(int32 number, int32 pile)
+    {
+        auto result = CheckTake(number, pile);
+        if (result == TakeResult::Ok)
+        {
+            auto& target = Piles[size_t(pile)];
+            auto old_count = target.Count();
+            target -= number;
+            Index.Update(Piles.Data(), size_t(pile), old_count);
+        }
+        return result;
+    }
+
+    int32 Game::NimSum() const
+    {
+        return Index.NimSum();
+    }
+
+    Move Game::CPUMove() const
+    {
+        return Index.CPUMove(Piles.Data());
+    }
+
+    bool Game::GameOver() const
+    {
+        return Index.AllEmpty();
+    }
+
+    void Game::Reindex()
+    {
+        Index.Rebuild(Piles.Data(), Piles.PileCount());
+    }
+}
@@ -0,0 +1,16 @@
+#include <nim/Random.h>
+#include <chrono>
+#include <random>
+
+namespace nim
+{
+    uint64 EntropySeed()
+    {
+        // random_device may be deterministic on some platforms, so mix in
+        // the clock as well
+        std::random_device device;
+        auto seed = (uint64(device()) << 32) | device();
+        seed ^= uint64(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+        return Random(seed).Next();
+    }
+}
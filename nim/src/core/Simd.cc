@@ -0,0 +1,539 @@
+#include <nim/Simd.h>
+#include <nim/Bits.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define NIM_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Lets a single function use instructions beyond the build's baseline
+#if defined(__GNUC__)
+#define NIM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NIM_TARGET(isa)
+#endif
+
+namespace nim
+{
+    namespace simd
+    {
+        namespace
+        {
+            // Appends base + i for every set bit i of lanes
+            inline size_t AppendLanes(uint32 lanes, size_t base, int32* indices, size_t found, size_t max_indices)
+            {
+                while (lanes)
+                {
+                    if (found < max_indices)
+                    {
+                        indices[found] = int32(base + LowestBitIndex(lanes));
+                    }
+                    ++found;
+                    lanes &= lanes - 1;
+                }
+                return found;
+            }
+
+            // Scalar
+
+            template <typename T>
+            T ScalarNimSum(const T* counts, size_t count)
+            {
+                return nim::NimSum(counts, count);
+            }
+
+            template <typename T>
+            size_t ScalarFirst(const T* counts, size_t count, T sum)
+            {
+                return nim::FindShrinkingPile(counts, count, sum);
+            }
+
+            template <typename T>
+            size_t ScalarAll(const T* counts, size_t count, T sum, int32* indices, size_t max_indices)
+            {
+                auto bit = HighestBitIndex(sum);
+                size_t found = 0;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (BitOf(counts[i], bit))
+                    {
+                        if (found < max_indices) { indices[found] = int32(i); }
+                        ++found;
+                    }
+                }
+                return found;
+            }
+
+#ifdef NIM_SIMD_X86
+
+            // SSE4.2: 4 x uint32 or 2 x uint64 per register, 4 registers per step
+
+            NIM_TARGET("sse4.2")
+            uint32 Sse42NimSum32(const uint32* counts, size_t count)
+            {
+                auto a0 = _mm_setzero_si128(), a1 = a0, a2 = a0, a3 = a0;
+                size_t i = 0;
+                for (; i + 16 <= count; i += 16)
+                {
+                    a0 = _mm_xor_si128(a0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i)));
+                    a1 = _mm_xor_si128(a1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i + 4)));
+                    a2 = _mm_xor_si128(a2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i + 8)));
+                    a3 = _mm_xor_si128(a3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i + 12)));
+                }
+                a0 = _mm_xor_si128(_mm_xor_si128(a0, a1), _mm_xor_si128(a2, a3));
+                a0 = _mm_xor_si128(a0, _mm_srli_si128(a0, 8));
+                a0 = _mm_xor_si128(a0, _mm_srli_si128(a0, 4));
+                auto sum = uint32(_mm_cvtsi128_si32(a0));
+                for (; i < count; ++i) { sum ^= counts[i]; }
+                return sum;
+            }
+
+            NIM_TARGET("sse4.2")
+            uint64 Sse42NimSum64(const uint64* counts, size_t count)
+            {
+                auto a0 = _mm_setzero_si128(), a1 = a0, a2 = a0, a3 = a0;
+                size_t i = 0;
+                for (; i + 8 <= count; i += 8)
+                {
+                    a0 = _mm_xor_si128(a0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i)));
+                    a1 = _mm_xor_si128(a1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i + 2)));
+                    a2 = _mm_xor_si128(a2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i + 4)));
+                    a3 = _mm_xor_si128(a3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i + 6)));
+                }
+                a0 = _mm_xor_si128(_mm_xor_si128(a0, a1), _mm_xor_si128(a2, a3));
+                uint64 lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), a0);
+                auto sum = lanes[0] ^ lanes[1];
+                for (; i < count; ++i) { sum ^= counts[i]; }
+                return sum;
+            }
+
+            // Bitmask of the lanes of 16 uint32 counts that have mask's bit
+            NIM_TARGET("sse4.2")
+            inline uint32 Sse42Lanes32(const uint32* counts, __m128i mask, bool& any)
+            {
+                auto v0 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts)), mask);
+                auto v1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + 4)), mask);
+                auto v2 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + 8)), mask);
+                auto v3 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + 12)), mask);
+                auto hits = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+                any = !_mm_testz_si128(hits, hits);
+                if (!any) { return 0; }
+                return uint32(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v0, mask))))
+                    | uint32(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v1, mask)))) << 4
+                    | uint32(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v2, mask)))) << 8
+                    | uint32(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v3, mask)))) << 12;
+            }
+
+            // Bitmask of the lanes of 8 uint64 counts that have mask's bit
+            NIM_TARGET("sse4.2")
+            inline uint32 Sse42Lanes64(const uint64* counts, __m128i mask, bool& any)
+            {
+                auto v0 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts)), mask);
+                auto v1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + 2)), mask);
+                auto v2 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + 4)), mask);
+                auto v3 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + 6)), mask);
+                auto hits = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+                any = !_mm_testz_si128(hits, hits);
+                if (!any) { return 0; }
+                return uint32(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v0, mask))))
+                    | uint32(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v1, mask)))) << 2
+                    | uint32(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v2, mask)))) << 4
+                    | uint32(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v3, mask)))) << 6;
+            }
+
+            NIM_TARGET("sse4.2")
+            size_t Sse42First32(const uint32* counts, size_t count, uint32 sum)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm_set1_epi32(int(uint32(1) << bit));
+                size_t i = 0;
+                for (; i + 16 <= count; i += 16)
+                {
+                    bool any;
+                    auto lanes = Sse42Lanes32(counts + i, mask, any);
+                    if (any) { return i + LowestBitIndex(lanes); }
+                }
+                return i + ScalarFirst(counts + i, count - i, sum);
+            }
+
+            NIM_TARGET("sse4.2")
+            size_t Sse42First64(const uint64* counts, size_t count, uint64 sum)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm_set1_epi64x(int64(uint64(1) << bit));
+                size_t i = 0;
+                for (; i + 8 <= count; i += 8)
+                {
+                    bool any;
+                    auto lanes = Sse42Lanes64(counts + i, mask, any);
+                    if (any) { return i + LowestBitIndex(lanes); }
+                }
+                return i + ScalarFirst(counts + i, count - i, sum);
+            }
+
+            NIM_TARGET("sse4.2")
+            size_t Sse42All32(const uint32* counts, size_t count, uint32 sum, int32* indices, size_t max_indices)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm_set1_epi32(int(uint32(1) << bit));
+                size_t found = 0;
+                size_t i = 0;
+                for (; i + 16 <= count; i += 16)
+                {
+                    bool any;
+                    found = AppendLanes(Sse42Lanes32(counts + i, mask, any), i, indices, found, max_indices);
+                }
+                for (; i < count; ++i)
+                {
+                    found = AppendLanes(uint32(BitOf(counts[i], bit) != 0), i, indices, found, max_indices);
+                }
+                return found;
+            }
+
+            NIM_TARGET("sse4.2")
+            size_t Sse42All64(const uint64* counts, size_t count, uint64 sum, int32* indices, size_t max_indices)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm_set1_epi64x(int64(uint64(1) << bit));
+                size_t found = 0;
+                size_t i = 0;
+                for (; i + 8 <= count; i += 8)
+                {
+                    bool any;
+                    found = AppendLanes(Sse42Lanes64(counts + i, mask, any), i, indices, found, max_indices);
+                }
+                for (; i < count; ++i)
+                {
+                    found = AppendLanes(uint32(BitOf(counts[i], bit) != 0), i, indices, found, max_indices);
+                }
+                return found;
+            }
+
+            // AVX2: 8 x uint32 or 4 x uint64 per register, 4 registers per step
+
+            NIM_TARGET("avx2")
+            inline __m128i Avx2Fold(__m256i v)
+            {
+                return _mm_xor_si128(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            }
+
+            NIM_TARGET("avx2")
+            uint32 Avx2NimSum32(const uint32* counts, size_t count)
+            {
+                auto a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+                size_t i = 0;
+                for (; i + 32 <= count; i += 32)
+                {
+                    a0 = _mm256_xor_si256(a0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i)));
+                    a1 = _mm256_xor_si256(a1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i + 8)));
+                    a2 = _mm256_xor_si256(a2, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i + 16)));
+                    a3 = _mm256_xor_si256(a3, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i + 24)));
+                }
+                auto a = Avx2Fold(_mm256_xor_si256(_mm256_xor_si256(a0, a1), _mm256_xor_si256(a2, a3)));
+                a = _mm_xor_si128(a, _mm_srli_si128(a, 8));
+                a = _mm_xor_si128(a, _mm_srli_si128(a, 4));
+                auto sum = uint32(_mm_cvtsi128_si32(a));
+                for (; i < count; ++i) { sum ^= counts[i]; }
+                return sum;
+            }
+
+            NIM_TARGET("avx2")
+            uint64 Avx2NimSum64(const uint64* counts, size_t count)
+            {
+                auto a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+                size_t i = 0;
+                for (; i + 16 <= count; i += 16)
+                {
+                    a0 = _mm256_xor_si256(a0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i)));
+                    a1 = _mm256_xor_si256(a1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i + 4)));
+                    a2 = _mm256_xor_si256(a2, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i + 8)));
+                    a3 = _mm256_xor_si256(a3, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i + 12)));
+                }
+                auto a = Avx2Fold(_mm256_xor_si256(_mm256_xor_si256(a0, a1), _mm256_xor_si256(a2, a3)));
+                uint64 lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), a);
+                auto sum = lanes[0] ^ lanes[1];
+                for (; i < count; ++i) { sum ^= counts[i]; }
+                return sum;
+            }
+
+            // Bitmask of the lanes of 32 uint32 counts that have mask's bit
+            NIM_TARGET("avx2")
+            inline uint32 Avx2Lanes32(const uint32* counts, __m256i mask, bool& any)
+            {
+                auto v0 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts)), mask);
+                auto v1 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + 8)), mask);
+                auto v2 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + 16)), mask);
+                auto v3 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + 24)), mask);
+                auto hits = _mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3));
+                any = !_mm256_testz_si256(hits, hits);
+                if (!any) { return 0; }
+                return uint32(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v0, mask))))
+                    | uint32(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v1, mask)))) << 8
+                    | uint32(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v2, mask)))) << 16
+                    | uint32(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v3, mask)))) << 24;
+            }
+
+            // Bitmask of the lanes of 16 uint64 counts that have mask's bit
+            NIM_TARGET("avx2")
+            inline uint32 Avx2Lanes64(const uint64* counts, __m256i mask, bool& any)
+            {
+                auto v0 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts)), mask);
+                auto v1 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + 4)), mask);
+                auto v2 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + 8)), mask);
+                auto v3 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + 12)), mask);
+                auto hits = _mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3));
+                any = !_mm256_testz_si256(hits, hits);
+                if (!any) { return 0; }
+                return uint32(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v0, mask))))
+                    | uint32(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v1, mask)))) << 4
+                    | uint32(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v2, mask)))) << 8
+                    | uint32(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v3, mask)))) << 12;
+            }
+
+            NIM_TARGET("avx2")
+            size_t Avx2First32(const uint32* counts, size_t count, uint32 sum)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm256_set1_epi32(int(uint32(1) << bit));
+                size_t i = 0;
+                for (; i + 32 <= count; i += 32)
+                {
+                    bool any;
+                    auto lanes = Avx2Lanes32(counts + i, mask, any);
+                    if (any) { return i + LowestBitIndex(lanes); }
+                }
+                return i + ScalarFirst(counts + i, count - i, sum);
+            }
+
+            NIM_TARGET("avx2")
+            size_t Avx2First64(const uint64* counts, size_t count, uint64 sum)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm256_set1_epi64x(int64(uint64(1) << bit));
+                size_t i = 0;
+                for (; i + 16 <= count; i += 16)
+                {
+                    bool any;
+                    auto lanes = Avx2Lanes64(counts + i, mask, any);
+                    if (any) { return i + LowestBitIndex(lanes); }
+                }
+                return i + ScalarFirst(counts + i, count - i, sum);
+            }
+
+            NIM_TARGET("avx2")
+            size_t Avx2All32(const uint32* counts, size_t count, uint32 sum, int32* indices, size_t max_indices)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm256_set1_epi32(int(uint32(1) << bit));
+                size_t found = 0;
+                size_t i = 0;
+                for (; i + 32 <= count; i += 32)
+                {
+                    bool any;
+                    found = AppendLanes(Avx2Lanes32(counts + i, mask, any), i, indices, found, max_indices);
+                }
+                for (; i < count; ++i)
+                {
+                    found = AppendLanes(uint32(BitOf(counts[i], bit) != 0), i, indices, found, max_indices);
+                }
+                return found;
+            }
+
+            NIM_TARGET("avx2")
+            size_t Avx2All64(const uint64* counts, size_t count, uint64 sum, int32* indices, size_t max_indices)
+            {
+                auto bit = HighestBitIndex(sum);
+                auto mask = _mm256_set1_epi64x(int64(uint64(1) << bit));
+                size_t found = 0;
+                size_t i = 0;
+                for (; i + 16 <= count; i += 16)
+                {
+                    bool any;
+                    found = AppendLanes(Avx2Lanes64(counts + i, mask, any), i, indices, found, max_indices);
+                }
+                for (; i < count; ++i)
+                {
+                    found = AppendLanes(uint32(BitOf(counts[i], bit) != 0), i, indices, found, max_indices);
+                }
+                return found;
+            }
+
+#endif // NIM_SIMD_X86
+
+            // Dispatch
+
+            struct Kernels
+            {
+                Isa Level;
+                uint32 (*NimSum32)(const uint32*, size_t);
+                uint64 (*NimSum64)(const uint64*, size_t);
+                size_t (*First32)(const uint32*, size_t, uint32);
+                size_t (*First64)(const uint64*, size_t, uint64);
+                size_t (*All32)(const uint32*, size_t, uint32, int32*, size_t);
+                size_t (*All64)(const uint64*, size_t, uint64, int32*, size_t);
+            };
+
+            const Kernels SCALAR_KERNELS = {
+                Isa::Scalar,
+                &ScalarNimSum<uint32>, &ScalarNimSum<uint64>,
+                &ScalarFirst<uint32>, &ScalarFirst<uint64>,
+                &ScalarAll<uint32>, &ScalarAll<uint64>
+            };
+
+#ifdef NIM_SIMD_X86
+            const Kernels SSE42_KERNELS = {
+                Isa::SSE42,
+                &Sse42NimSum32, &Sse42NimSum64,
+                &Sse42First32, &Sse42First64,
+                &Sse42All32, &Sse42All64
+            };
+
+            const Kernels AVX2_KERNELS = {
+                Isa::AVX2,
+                &Avx2NimSum32, &Avx2NimSum64,
+                &Avx2First32, &Avx2First64,
+                &Avx2All32, &Avx2All64
+            };
+#endif
+
+            const Kernels* KernelsFor(Isa isa)
+            {
+                switch (isa)
+                {
+#ifdef NIM_SIMD_X86
+                    case Isa::AVX2: return &AVX2_KERNELS;
+                    case Isa::SSE42: return &SSE42_KERNELS;
+#endif
+                    default: return &SCALAR_KERNELS;
+                }
+            }
+
+            Isa DetectIsa()
+            {
+#if defined(NIM_SIMD_X86) && defined(__GNUC__)
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2")) { return Isa::AVX2; }
+                if (__builtin_cpu_supports("sse4.2")) { return Isa::SSE42; }
+#elif defined(NIM_SIMD_X86) && defined(_MSC_VER)
+                int info[4];
+                __cpuid(info, 0);
+                auto max_leaf = info[0];
+                __cpuid(info, 1);
+                auto sse42 = (info[2] & (1 << 20)) != 0;
+                // AVX state must also be enabled by the OS (XCR0 bits 1 and 2)
+                auto os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+                if (max_leaf >= 7 && os_avx)
+                {
+                    __cpuidex(info, 7, 0);
+                    if (info[1] & (1 << 5)) { return Isa::AVX2; }
+                }
+                if (sse42) { return Isa::SSE42; }
+#endif
+                return Isa::Scalar;
+            }
+
+            std::atomic<const Kernels*> ActiveKernels(nullptr);
+
+            const Kernels& Active()
+            {
+                auto kernels = ActiveKernels.load(std::memory_order_acquire);
+                if (!kernels)
+                {
+                    kernels = KernelsFor(BestIsa());
+                    ActiveKernels.store(kernels, std::memory_order_release);
+                }
+                return *kernels;
+            }
+
+            template <typename T>
+            BasicMove<T> KernelCPUMove(const T* counts, size_t count)
+            {
+                auto sum = NimSum(counts, count);
+                if (sum != 0)
+                {
+                    auto index = FindShrinkingPile(counts, count, sum);
+                    if (index < count)
+                    {
+                        return { T(counts[index] - (counts[index] ^ sum)), int32(index) };
+                    }
+                }
+                return { T(1), int32(nim::FindBiggestPile(counts, count)) };
+            }
+        }
+
+        Isa BestIsa()
+        {
+            static const Isa best = DetectIsa();
+            return best;
+        }
+
+        Isa ActiveIsa()
+        {
+            return Active().Level;
+        }
+
+        bool SetIsa(Isa isa)
+        {
+            if (int(isa) > int(BestIsa())) { return false; }
+            ActiveKernels.store(KernelsFor(isa), std::memory_order_release);
+            return true;
+        }
+
+        const char* IsaName(Isa isa)
+        {
+            switch (isa)
+            {
+                case Isa::Scalar: return "scalar";
+                case Isa::SSE42: return "sse4.2";
+                case Isa::AVX2: return "avx2";
+            }
+            return "unknown";
+        }
+
+        uint32 NimSum(const uint32* counts, size_t count)
+        {
+            return Active().NimSum32(counts, count);
+        }
+
+        uint64 NimSum(const uint64* counts, size_t count)
+        {
+            return Active().NimSum64(counts, count);
+        }
+
+        size_t FindShrinkingPile(const uint32* counts, size_t count, uint32 sum)
+        {
+            return Active().First32(counts, count, sum);
+        }
+
+        size_t FindShrinkingPile(const uint64* counts, size_t count, uint64 sum)
+        {
+            return Active().First64(counts, count, sum);
+        }
+
+        size_t FindShrinkingPiles(const uint32* counts, size_t count, uint32 sum, int32* indices, size_t max_indices)
+        {
+            return Active().All32(counts, count, sum, indices, max_indices);
+        }
+
+        size_t FindShrinkingPiles(const uint64* counts, size_t count, uint64 sum, int32* indices, size_t max_indices)
+        {
+            return Active().All64(counts, count, sum, indices, max_indices);
+        }
+
+        BasicMove<uint32> CPUMove(const uint32* counts, size_t count)
+        {
+            return KernelCPUMove(counts, count);
+        }
+
+        BasicMove<uint64> CPUMove(const uint64* counts, size_t count)
+        {
+            return KernelCPUMove(counts, count);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include <nim/Simulator.h>
+#include <atomic>
+#include <chrono>
+
+// Games per chunk handed to a pool thread
+#define SIMULATION_GRAIN 256
+
+namespace nim
+{
+    namespace
+    {
+        Move RandomMove(Game& game)
+        {
+            auto& random = game.GetRandom();
+            auto pile_count = game.PileCount();
+            auto pile = int32(random.Below(uint32(pile_count)));
+            // step to the next non-empty pile; the caller made sure there is one
+            while (game.GetPile(pile) == 0)
+            {
+                pile = (pile + 1) % pile_count;
+            }
+            return { 1 + int32(random.Below(uint32(game.GetPile(pile).Count()))), pile };
+        }
+
+        struct SimulationTotals
+        {
+            std::atomic<uint64> Moves{ 0 };
+            std::atomic<uint64> Player1Wins{ 0 };
+            std::atomic<uint64> FirstMoverWins{ 0 };
+            std::atomic<uint64> WinningStarts{ 0 };
+        };
+
+        struct SimulationRange
+        {
+            const SimulationOptions& Options;
+            SimulationTotals& Totals;
+
+            void operator ()(size_t begin, size_t end) const
+            {
+                Game game(Options.PileCount, Options.Seed);
+                uint64 moves = 0, player1_wins = 0, first_mover_wins = 0, winning_starts = 0;
+
+                for (auto i = begin; i < end; ++i)
+                {
+                    game.Seed(Options.Seed, uint64(i));
+                    game.Rnd();
+                    game.DecideTurn();
+                    auto first_mover = game.Player1Turn;
+                    winning_starts += (game.NimSum() != 0);
+
+                    // the player who takes the last chip wins
+                    while (!game.GameOver())
+                    {
+                        auto cpu = game.Player1Turn || Options.Player2 == Opponent::CPU;
+                        auto move = cpu ? game.CPUMove() : RandomMove(game);
+                        game.Take(move.Number, move.Pile);
+                        game.SwitchTurn();
+                        ++moves;
+                    }
+                    // the turn has already passed on to the loser
+                    auto player1_won = !game.Player1Turn;
+                    player1_wins += player1_won;
+                    first_mover_wins += (player1_won == first_mover);
+                }
+
+                Totals.Moves += moves;
+                Totals.Player1Wins += player1_wins;
+                Totals.FirstMoverWins += first_mover_wins;
+                Totals.WinningStarts += winning_starts;
+            }
+        };
+    }
+
+    SimulationStats Simulate(const SimulationOptions& options, ThreadPool* pool)
+    {
+        SimulationTotals totals;
+        SimulationRange range{ options, totals };
+
+        auto start = std::chrono::steady_clock::now();
+        if (pool)
+        {
+            pool->ParallelFor(size_t(options.Games), SIMULATION_GRAIN, range);
+        }
+        else
+        {
+            range(0, size_t(options.Games));
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        SimulationStats stats;
+        stats.Games = options.Games;
+        stats.Moves = totals.Moves;
+        stats.Player1Wins = totals.Player1Wins;
+        stats.FirstMoverWins = totals.FirstMoverWins;
+        stats.WinningStarts = totals.WinningStarts;
+        stats.Seconds = std::chrono::duration<double>(elapsed).count();
+        return stats;
+    }
+}
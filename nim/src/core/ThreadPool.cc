@@ -0,0 +1,154 @@
+#include <nim/ThreadPool.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nim
+{
+    struct ThreadPool::impl
+    {
+        std::vector<std::thread> Workers;
+
+        std::mutex CallMutex;   // one loop at a time
+        std::mutex Mutex;
+        std::condition_variable WorkReady;
+        std::condition_variable WorkDone;
+
+        // current loop
+        Task Body = nullptr;
+        void* Context = nullptr;
+        size_t Count = 0;
+        size_t Grain = 1;
+        size_t ChunkCount = 0;
+        std::atomic<size_t> NextChunk{ 0 };
+        std::atomic<size_t> DoneChunks{ 0 };
+
+        uint64 Generation = 0;
+        size_t Busy = 0;        // workers inside the current loop
+        bool Stop = false;
+
+        // Runs chunks until there are none left, returns how many it ran
+        size_t Work()
+        {
+            size_t done = 0;
+            for (;;)
+            {
+                auto chunk = NextChunk.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= ChunkCount) { break; }
+                auto begin = chunk * Grain;
+                auto end = std::min(Count, begin + Grain);
+                Body(Context, begin, end);
+                ++done;
+            }
+            return done;
+        }
+
+        void WorkerLoop()
+        {
+            uint64 seen = 0;
+            std::unique_lock<std::mutex> lock(Mutex);
+            for (;;)
+            {
+                WorkReady.wait(lock, [&] { return Stop || Generation != seen; });
+                if (Stop) { return; }
+                seen = Generation;
+                ++Busy;
+                lock.unlock();
+
+                auto done = Work();
+
+                lock.lock();
+                --Busy;
+                DoneChunks.fetch_add(done, std::memory_order_relaxed);
+                if (Busy == 0) { WorkDone.notify_all(); }
+            }
+        }
+    };
+
+    ThreadPool::ThreadPool(size_t threads) :
+        m_impl(new ThreadPool::impl())
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        try
+        {
+            // the calling thread is one of them
+            m_impl->Workers.reserve(threads - 1);
+            for (size_t i = 1; i < threads; ++i)
+            {
+                m_impl->Workers.emplace_back(&impl::WorkerLoop, m_impl);
+            }
+        }
+        catch (...)
+        {
+            Shutdown();
+            throw;
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Shutdown();
+    }
+
+    void ThreadPool::Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_impl->Mutex);
+            m_impl->Stop = true;
+        }
+        m_impl->WorkReady.notify_all();
+        for (auto& worker : m_impl->Workers)
+        {
+            worker.join();
+        }
+        delete m_impl;
+    }
+
+    size_t ThreadPool::ThreadCount() const
+    {
+        return m_impl->Workers.size() + 1;
+    }
+
+    void ThreadPool::ParallelFor(size_t count, size_t grain, Task task, void* context)
+    {
+        if (count == 0) { return; }
+        grain = std::max<size_t>(grain, 1);
+        auto chunks = (count + grain - 1) / grain;
+        if (chunks == 1 || m_impl->Workers.empty())
+        {
+            task(context, 0, count);
+            return;
+        }
+
+        auto& pool = *m_impl;
+        std::lock_guard<std::mutex> call_lock(pool.CallMutex);
+        {
+            std::unique_lock<std::mutex> lock(pool.Mutex);
+            // a worker that woke too late for the previous loop may still be
+            // looking at its (exhausted) chunk counter
+            pool.WorkDone.wait(lock, [&] { return pool.Busy == 0; });
+            pool.Body = task;
+            pool.Context = context;
+            pool.Count = count;
+            pool.Grain = grain;
+            pool.ChunkCount = chunks;
+            pool.NextChunk.store(0, std::memory_order_relaxed);
+            pool.DoneChunks.store(0, std::memory_order_relaxed);
+            ++pool.Generation;
+        }
+        pool.WorkReady.notify_all();
+
+        auto done = pool.Work();
+
+        std::unique_lock<std::mutex> lock(pool.Mutex);
+        pool.DoneChunks.fetch_add(done, std::memory_order_relaxed);
+        // every chunk finished and no worker still holds on to this loop
+        pool.WorkDone.wait(lock, [&] { return pool.Busy == 0 && pool.DoneChunks.load(std::memory_order_relaxed) == chunks; });
+    }
+}
@@ -0,0 +1,322 @@
+#include <nim/nim_core.h>
+#include <nim/Game.h>
+#include <nim/Simd.h>
+#include <nim/Batch.h>
+#include <nim/ThreadPool.h>
+#include <new>
+
+using nim::Game;
+using nim::TakeResult;
+using nim::UInt128;
+
+// 128-bit piles are handed over as pairs of uint64, low half first
+static_assert(sizeof(UInt128) == 2 * sizeof(uint64_t), "UInt128 has to be exactly its two limbs");
+
+struct nim_game
+{
+    explicit nim_game(int32_t pile_count) : game(pile_count) {}
+
+    Game game;
+};
+
+struct nim_thread_pool
+{
+    explicit nim_thread_pool(size_t thread_count) : pool(thread_count) {}
+
+    nim::ThreadPool pool;
+};
+
+namespace
+{
+    nim_result ToResult(TakeResult result)
+    {
+        switch (result)
+        {
+            case TakeResult::Ok: return NIM_OK;
+            case TakeResult::PileRange: return NIM_ERR_PILE_RANGE;
+            case TakeResult::PileEmpty: return NIM_ERR_PILE_EMPTY;
+            case TakeResult::NumberRange: return NIM_ERR_NUMBER_RANGE;
+        }
+        return NIM_ERR_ARGUMENT;
+    }
+
+    template <typename T>
+    size_t PositionWinningPiles(const T* counts, size_t pile_count, int32_t* indices, size_t max_indices)
+    {
+        if (!counts || (!indices && max_indices)) { return 0; }
+        auto sum = nim::simd::NimSum(counts, pile_count);
+        if (sum == 0) { return 0; }
+        return nim::simd::FindShrinkingPiles(counts, pile_count, sum, indices, max_indices);
+    }
+
+    // Scalar counterpart of PositionWinningPiles, for counts simd does not
+    // cover
+    template <typename T>
+    size_t ScalarWinningPiles(const T* counts, size_t pile_count, int32_t* indices, size_t max_indices)
+    {
+        if (!counts || (!indices && max_indices)) { return 0; }
+        auto sum = nim::NimSum(counts, pile_count);
+        if (nim::IsZero(sum)) { return 0; }
+        size_t found = 0;
+        for (size_t i = 0; i < pile_count; ++i)
+        {
+            if ((counts[i] ^ sum) < counts[i])
+            {
+                if (found < max_indices) { indices[found] = int32_t(i); }
+                ++found;
+            }
+        }
+        return found;
+    }
+
+    template <typename T>
+    nim_result PositionCPUMove(const T* counts, size_t pile_count, T* number, int32_t* pile)
+    {
+        if (!counts || !number || !pile) { return NIM_ERR_ARGUMENT; }
+        if (nim::AllEmpty(counts, pile_count)) { return NIM_ERR_GAME_OVER; }
+        auto move = nim::simd::CPUMove(counts, pile_count);
+        *number = move.Number;
+        *pile = move.Pile;
+        return NIM_OK;
+    }
+
+    template <typename T, typename Batch>
+    nim_result BatchAnalyze(const Batch* batch, nim_thread_pool* pool)
+    {
+        if (!batch || (!batch->counts && batch->position_count)) { return NIM_ERR_ARGUMENT; }
+        nim::BatchInput<T> input{ batch->counts, batch->offsets, batch->pile_count, batch->position_count };
+        nim::BatchOutput<T> output{ batch->winning, batch->nim_sums, batch->move_numbers, batch->move_piles,
+            batch->winning_piles, batch->winning_numbers, batch->winning_counts };
+        nim::AnalyzeBatch(input, output, pool ? &pool->pool : nullptr);
+        return NIM_OK;
+    }
+}
+
+extern "C"
+{
+    nim_game* nim_game_create(void)
+    {
+        try
+        {
+            return new nim_game(Game::PILE_COUNT);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+
+    nim_game* nim_game_create_with_piles(int32_t pile_count)
+    {
+        if (pile_count < 1) { return nullptr; }
+        try
+        {
+            return new nim_game(pile_count);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+
+    void nim_game_destroy(nim_game* game)
+    {
+        delete game;
+    }
+
+    void nim_game_seed(nim_game* game, uint64_t seed)
+    {
+        game->game.Seed(seed);
+    }
+
+    nim_result nim_game_randomize(nim_game* game)
+    {
+        try
+        {
+            game->game.Rnd();
+            return NIM_OK;
+        }
+        catch (const std::bad_alloc&)
+        {
+            return NIM_ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    int32_t nim_game_pile_count(const nim_game* game)
+    {
+        return game->game.PileCount();
+    }
+
+    nim_result nim_game_get_pile(const nim_game* game, int32_t pile, int32_t* count)
+    {
+        if (!count) { return NIM_ERR_ARGUMENT; }
+        if (pile < 0 || pile >= game->game.PileCount()) { return NIM_ERR_PILE_RANGE; }
+        *count = game->game.GetPile(pile);
+        return NIM_OK;
+    }
+
+    nim_result nim_game_set_pile(nim_game* game, int32_t pile, int32_t count)
+    {
+        try
+        {
+            return ToResult(game->game.SetPile(pile, count));
+        }
+        catch (const std::bad_alloc&)
+        {
+            return NIM_ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    nim_result nim_game_set_piles(nim_game* game, const int32_t* counts, int32_t pile_count)
+    {
+        if (!counts) { return NIM_ERR_ARGUMENT; }
+        try
+        {
+            return ToResult(game->game.SetPiles(counts, pile_count));
+        }
+        catch (const std::bad_alloc&)
+        {
+            return NIM_ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    int nim_game_player1_turn(const nim_game* game)
+    {
+        return game->game.Player1Turn ? 1 : 0;
+    }
+
+    void nim_game_set_player1_turn(nim_game* game, int player1_turn)
+    {
+        game->game.Player1Turn = (player1_turn != 0);
+    }
+
+    void nim_game_switch_turn(nim_game* game)
+    {
+        game->game.SwitchTurn();
+    }
+
+    nim_result nim_game_take(nim_game* game, int32_t number, int32_t pile)
+    {
+        try
+        {
+            return ToResult(game->game.Take(number, pile));
+        }
+        catch (const std::bad_alloc&)
+        {
+            return NIM_ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    nim_result nim_game_cpu_move(const nim_game* game, int32_t* number, int32_t* pile)
+    {
+        if (!number || !pile) { return NIM_ERR_ARGUMENT; }
+        if (game->game.GameOver()) { return NIM_ERR_GAME_OVER; }
+        auto move = game->game.CPUMove();
+        *number = move.Number;
+        *pile = move.Pile;
+        return NIM_OK;
+    }
+
+    int32_t nim_game_nim_sum(const nim_game* game)
+    {
+        return game->game.NimSum();
+    }
+
+    int nim_game_over(const nim_game* game)
+    {
+        return game->game.GameOver() ? 1 : 0;
+    }
+
+    uint32_t nim_position_nim_sum_u32(const uint32_t* counts, size_t pile_count)
+    {
+        return counts ? nim::simd::NimSum(counts, pile_count) : 0;
+    }
+
+    uint64_t nim_position_nim_sum_u64(const uint64_t* counts, size_t pile_count)
+    {
+        return counts ? nim::simd::NimSum(counts, pile_count) : 0;
+    }
+
+    nim_result nim_position_cpu_move_u32(const uint32_t* counts, size_t pile_count, uint32_t* number, int32_t* pile)
+    {
+        return PositionCPUMove(counts, pile_count, number, pile);
+    }
+
+    nim_result nim_position_cpu_move_u64(const uint64_t* counts, size_t pile_count, uint64_t* number, int32_t* pile)
+    {
+        return PositionCPUMove(counts, pile_count, number, pile);
+    }
+
+    size_t nim_position_winning_piles_u32(const uint32_t* counts, size_t pile_count, int32_t* indices, size_t max_indices)
+    {
+        return PositionWinningPiles(counts, pile_count, indices, max_indices);
+    }
+
+    size_t nim_position_winning_piles_u64(const uint64_t* counts, size_t pile_count, int32_t* indices, size_t max_indices)
+    {
+        return PositionWinningPiles(counts, pile_count, indices, max_indices);
+    }
+
+    void nim_position_nim_sum_u128(const uint64_t* counts, size_t pile_count, uint64_t* nim_sum)
+    {
+        if (!nim_sum) { return; }
+        auto sum = counts ? nim::NimSum(reinterpret_cast<const UInt128*>(counts), pile_count) : UInt128();
+        nim_sum[0] = sum.Limbs[0];
+        nim_sum[1] = sum.Limbs[1];
+    }
+
+    nim_result nim_position_cpu_move_u128(const uint64_t* counts, size_t pile_count, uint64_t* number, int32_t* pile)
+    {
+        if (!counts || !number || !pile) { return NIM_ERR_ARGUMENT; }
+        auto piles = reinterpret_cast<const UInt128*>(counts);
+        if (nim::AllEmpty(piles, pile_count)) { return NIM_ERR_GAME_OVER; }
+        auto move = nim::CPUMove(piles, pile_count);
+        number[0] = move.Number.Limbs[0];
+        number[1] = move.Number.Limbs[1];
+        *pile = move.Pile;
+        return NIM_OK;
+    }
+
+    size_t nim_position_winning_piles_u128(const uint64_t* counts, size_t pile_count, int32_t* indices, size_t max_indices)
+    {
+        return ScalarWinningPiles(reinterpret_cast<const UInt128*>(counts), pile_count, indices, max_indices);
+    }
+
+    nim_thread_pool* nim_thread_pool_create(size_t thread_count)
+    {
+        try
+        {
+            return new nim_thread_pool(thread_count);
+        }
+        catch (...)
+        {
+            // bad_alloc or std::system_error from starting a thread
+            return nullptr;
+        }
+    }
+
+    void nim_thread_pool_destroy(nim_thread_pool* pool)
+    {
+        delete pool;
+    }
+
+    size_t nim_thread_pool_thread_count(const nim_thread_pool* pool)
+    {
+        return pool->pool.ThreadCount();
+    }
+
+    nim_result nim_batch_analyze_u32(const nim_batch_u32* batch, nim_thread_pool* pool)
+    {
+        return BatchAnalyze<uint32_t>(batch, pool);
+    }
+
+    nim_result nim_batch_analyze_u64(const nim_batch_u64* batch, nim_thread_pool* pool)
+    {
+        return BatchAnalyze<uint64_t>(batch, pool);
+    }
+
+    const char* nim_simd_isa(void)
+    {
+        return nim::simd::IsaName(nim::simd::ActiveIsa());
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * input.hpp
+ *
+ * Buffered line input for scripted sessions: reads a file descriptor in
+ * large blocks and hands out lines as views into its buffer, so piping in
+ * millions of commands costs a read() per block instead of terminal
+ * syscalls per character.
+ */
+
+#ifndef __nim_input_hpp__
+#define __nim_input_hpp__
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include "command.hpp"
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace nim
+{
+    namespace detail
+    {
+        // Whether fd is a terminal (as opposed to a pipe or a file)
+        inline bool IsTerminal(int fd)
+        {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+            return ::_isatty(fd) != 0;
+#else
+            return ::isatty(fd) != 0;
+#endif
+        }
+
+        class LineReader
+        {
+        public:
+            static const size_t BLOCK_SIZE = 1 << 16;
+
+            explicit LineReader(int fd) : fd(fd), begin(0), end(0), eof(false), buffer(BLOCK_SIZE) {}
+
+            // Next line without its "\n" or "\r\n". The view stays valid until
+            // the next call. Returns false once the input is exhausted.
+            bool ReadLine(StringView& line)
+            {
+                for (;;)
+                {
+                    auto data = buffer.data();
+                    if (auto newline = static_cast<const char*>(std::memchr(data + begin, '\n', end - begin)))
+                    {
+                        line = Trimmed(data + begin, size_t(newline - (data + begin)));
+                        begin = size_t(newline - data) + 1;
+                        return true;
+                    }
+                    if (eof)
+                    {
+                        if (begin == end) { return false; }
+                        // last line without a newline
+                        line = Trimmed(data + begin, end - begin);
+                        begin = end;
+                        return true;
+                    }
+                    Fill();
+                }
+            }
+
+            // Whether ReadLine can return a line without reading first, that
+            // is without waiting for more input
+            bool Buffered() const
+            {
+                if (eof) { return begin != end; }
+                return std::memchr(buffer.data() + begin, '\n', end - begin) != nullptr;
+            }
+
+        private:
+            static StringView Trimmed(const char* data, size_t size)
+            {
+                if (size && data[size - 1] == '\r') { --size; }
+                return StringView(data, size);
+            }
+
+            // Reads another block behind the unconsumed data, compacting or
+            // growing the buffer when there is no room left
+            void Fill()
+            {
+                if (begin > 0)
+                {
+                    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                    end -= begin;
+                    begin = 0;
+                }
+                if (buffer.size() - end < BLOCK_SIZE / 2)
+                {
+                    // a line longer than the buffer
+                    buffer.resize(buffer.size() * 2);
+                }
+                for (;;)
+                {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+                    auto count = ::_read(fd, buffer.data() + end, unsigned(buffer.size() - end));
+#else
+                    auto count = ::read(fd, buffer.data() + end, buffer.size() - end);
+#endif
+                    if (count > 0)
+                    {
+                        end += size_t(count);
+                        return;
+                    }
+                    if (count < 0 && errno == EINTR) { continue; }
+                    // end of input, or an error we cannot do anything about
+                    eof = true;
+                    return;
+                }
+            }
+
+            int fd;
+            size_t begin;
+            size_t end;
+            bool eof;
+            std::vector<char> buffer;
+        };
+    }
+}
+
+#endif /* __nim_input_hpp__ */
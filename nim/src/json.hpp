@@ -0,0 +1,480 @@
+/*
+ * json.hpp
+ *
+ * Just enough JSON for the machine protocol: one flat object per request
+ * line (string, number, boolean and null members, and arrays of numbers),
+ * and replies written straight into an output string. Both
+ * sides reuse their buffers, so a request costs no allocation once they
+ * have grown to its size.
+ */
+
+#ifndef __nim_json_hpp__
+#define __nim_json_hpp__
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nim/nim_stdtypes.h>
+#include "command.hpp"
+#include "parse.hpp"
+
+namespace nim
+{
+    namespace detail
+    {
+        struct JsonValue
+        {
+            enum class Type
+            {
+                Null,
+                Bool,
+                Number,
+                String,
+                Array
+            };
+
+            Type Kind = Type::Null;
+            bool Bool = false;
+            bool Integer = false;   // a number that is whole, such as 3, 3.0 or 3e2
+            int64 Number = 0;       // its value, held at int64's limits beyond them
+            StringView String;      // unescaped
+            size_t First = 0;       // an array's elements, in JsonObject::Element
+            size_t Count = 0;
+            StringView Raw;         // the value as written, to echo it back
+        };
+
+        // A parsed request. Views point into the line and into the object
+        // itself, so they are good until the next Parse.
+        class JsonObject
+        {
+        public:
+            // False if line is not a single flat object
+            bool Parse(const StringView& line)
+            {
+                members.clear();
+                numbers.clear();
+                decoded.clear();
+                // unescaped strings are never longer than the line, so
+                // with this much room the views into decoded stay put
+                decoded.reserve(line.Size);
+                p = line.Data;
+                end = line.Data + line.Size;
+
+                if (!Expect('{')) { return false; }
+                SkipSpace();
+                if (p != end && *p == '}')
+                {
+                    ++p;
+                    return AtEnd();
+                }
+                for (;;)
+                {
+                    std::pair<StringView, JsonValue> member;
+                    SkipSpace();
+                    if (!ParseString(member.first) || !Expect(':') || !ParseValue(member.second)) { return false; }
+                    members.push_back(member);
+                    SkipSpace();
+                    if (p == end) { return false; }
+                    if (*p == '}')
+                    {
+                        ++p;
+                        return AtEnd();
+                    }
+                    if (*p++ != ',') { return false; }
+                }
+            }
+
+            // The member called key, null if there is none
+            const JsonValue* Find(const StringView& key) const
+            {
+                for (const auto& member : members)
+                {
+                    if (member.first.Size == key.Size && std::memcmp(member.first.Data, key.Data, key.Size) == 0)
+                    {
+                        return &member.second;
+                    }
+                }
+                return nullptr;
+            }
+
+            const JsonValue& Element(const JsonValue& array, size_t i) const
+            {
+                return numbers[array.First + i];
+            }
+
+        private:
+            void SkipSpace()
+            {
+                while (p != end && IsSpace(*p)) { ++p; }
+            }
+
+            bool Expect(char c)
+            {
+                SkipSpace();
+                if (p == end || *p != c) { return false; }
+                ++p;
+                return true;
+            }
+
+            bool AtEnd()
+            {
+                SkipSpace();
+                return p == end;
+            }
+
+            bool ParseValue(JsonValue& value)
+            {
+                SkipSpace();
+                if (p == end) { return false; }
+                auto start = p;
+                auto ok = true;
+                switch (*p)
+                {
+                    case '"':
+                        value.Kind = JsonValue::Type::String;
+                        ok = ParseString(value.String);
+                        break;
+                    case '[':
+                        value.Kind = JsonValue::Type::Array;
+                        ok = ParseArray(value);
+                        break;
+                    case 't':
+                        value.Kind = JsonValue::Type::Bool;
+                        value.Bool = true;
+                        ok = Word("true");
+                        break;
+                    case 'f':
+                        value.Kind = JsonValue::Type::Bool;
+                        ok = Word("false");
+                        break;
+                    case 'n':
+                        ok = Word("null");
+                        break;
+                    default:
+                        ok = ParseNumber(value);
+                        break;
+                }
+                value.Raw = StringView(start, size_t(p - start));
+                return ok;
+            }
+
+            bool Word(const char* word)
+            {
+                auto size = std::strlen(word);
+                if (size_t(end - p) < size || std::memcmp(p, word, size) != 0) { return false; }
+                p += size;
+                return true;
+            }
+
+            bool Digits()
+            {
+                auto start = p;
+                while (p != end && *p >= '0' && *p <= '9') { ++p; }
+                return p != start;
+            }
+
+            // Any number JSON allows. Nothing in the protocol has a fraction,
+            // but whether a value is whole, and in range, is for the request
+            // to judge: a number written as a plain integer is read exactly,
+            // anything else as a double.
+            bool ParseNumber(JsonValue& value)
+            {
+                auto start = p;
+                if (p != end && *p == '-') { ++p; }
+                if (p != end && *p == '0')
+                {
+                    ++p;
+                }
+                else if (!Digits())
+                {
+                    return false;
+                }
+                auto plain = true;
+                if (p != end && *p == '.')
+                {
+                    ++p;
+                    if (!Digits()) { return false; }
+                    plain = false;
+                }
+                if (p != end && (*p == 'e' || *p == 'E'))
+                {
+                    ++p;
+                    if (p != end && (*p == '+' || *p == '-')) { ++p; }
+                    if (!Digits()) { return false; }
+                    plain = false;
+                }
+
+                value.Kind = JsonValue::Type::Number;
+                if (plain && numerics::from_chars(start, p, value.Number).ec == numerics::parse_errc::ok)
+                {
+                    value.Integer = true;
+                    return true;
+                }
+                double real = 0;
+                if (numerics::from_chars(start, p, real).ec == numerics::parse_errc::result_out_of_range)
+                {
+                    real = *start == '-' ? -HUGE_VAL : HUGE_VAL;
+                }
+                value.Integer = std::floor(real) == real;
+                // 2^63, the first double past int64
+                const double limit = 9223372036854775808.0;
+                value.Number = real >= limit ? std::numeric_limits<int64>::max() :
+                               real <= -limit ? std::numeric_limits<int64>::min() : int64(real);
+                return true;
+            }
+
+            bool ParseArray(JsonValue& value)
+            {
+                ++p;
+                value.First = numbers.size();
+                SkipSpace();
+                if (p != end && *p == ']')
+                {
+                    ++p;
+                    return true;
+                }
+                for (;;)
+                {
+                    JsonValue number;
+                    SkipSpace();
+                    auto start = p;
+                    if (!ParseNumber(number)) { return false; }
+                    number.Raw = StringView(start, size_t(p - start));
+                    numbers.push_back(number);
+                    ++value.Count;
+                    SkipSpace();
+                    if (p == end) { return false; }
+                    if (*p == ']')
+                    {
+                        ++p;
+                        return true;
+                    }
+                    if (*p++ != ',') { return false; }
+                }
+            }
+
+            // A string without escapes is a view into the line; one with
+            // them is unescaped into decoded
+            bool ParseString(StringView& string)
+            {
+                if (p == end || *p != '"') { return false; }
+                auto begin = ++p;
+                while (p != end && *p != '"' && *p != '\\') { ++p; }
+                if (p == end) { return false; }
+                if (*p == '"')
+                {
+                    string = StringView(begin, size_t(p - begin));
+                    ++p;
+                    return true;
+                }
+                auto start = decoded.size();
+                decoded.append(begin, size_t(p - begin));
+                while (p != end && *p != '"')
+                {
+                    if (*p != '\\')
+                    {
+                        decoded.push_back(*p++);
+                        continue;
+                    }
+                    if (++p == end) { return false; }
+                    switch (*p++)
+                    {
+                        case '"': decoded.push_back('"'); break;
+                        case '\\': decoded.push_back('\\'); break;
+                        case '/': decoded.push_back('/'); break;
+                        case 'b': decoded.push_back('\b'); break;
+                        case 'f': decoded.push_back('\f'); break;
+                        case 'n': decoded.push_back('\n'); break;
+                        case 'r': decoded.push_back('\r'); break;
+                        case 't': decoded.push_back('\t'); break;
+                        case 'u':
+                        {
+                            // \uXXXX comes out as UTF-8; a surrogate half
+                            // is taken as is, as nothing here needs it
+                            uint32 code = 0;
+                            for (auto i = 0; i < 4; ++i, ++p)
+                            {
+                                if (p == end) { return false; }
+                                auto digit = numerics::internal::digit_value(*p);
+                                if (digit >= 16) { return false; }
+                                code = code * 16 + digit;
+                            }
+                            AppendUtf8(code);
+                            break;
+                        }
+                        default:
+                            return false;
+                    }
+                }
+                if (p == end) { return false; }
+                ++p;
+                string = StringView(decoded.data() + start, decoded.size() - start);
+                return true;
+            }
+
+            void AppendUtf8(uint32 code)
+            {
+                if (code < 0x80)
+                {
+                    decoded.push_back(char(code));
+                }
+                else if (code < 0x800)
+                {
+                    decoded.push_back(char(0xC0 | (code >> 6)));
+                    decoded.push_back(char(0x80 | (code & 0x3F)));
+                }
+                else
+                {
+                    decoded.push_back(char(0xE0 | (code >> 12)));
+                    decoded.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+                    decoded.push_back(char(0x80 | (code & 0x3F)));
+                }
+            }
+
+            const char* p = nullptr;
+            const char* end = nullptr;
+            std::vector<std::pair<StringView, JsonValue>> members;
+            std::vector<JsonValue> numbers;
+            std::string decoded;
+        };
+
+        // Appends one JSON value to out, commas included:
+        //   JsonWriter(out).Begin().Key("ok").Bool(true).End();
+        class JsonWriter
+        {
+        public:
+            explicit JsonWriter(std::string& out) : out(out), separate(false) {}
+
+            JsonWriter& Begin()
+            {
+                Separate();
+                out.push_back('{');
+                separate = false;
+                return *this;
+            }
+
+            JsonWriter& End()
+            {
+                out.push_back('}');
+                separate = true;
+                return *this;
+            }
+
+            JsonWriter& BeginArray()
+            {
+                Separate();
+                out.push_back('[');
+                separate = false;
+                return *this;
+            }
+
+            JsonWriter& EndArray()
+            {
+                out.push_back(']');
+                separate = true;
+                return *this;
+            }
+
+            // Keys are literals, never in need of escapes
+            JsonWriter& Key(const StringView& key)
+            {
+                Separate();
+                out.push_back('"');
+                out.append(key.Data, key.Size);
+                out += "\":";
+                separate = false;
+                return *this;
+            }
+
+            JsonWriter& Int(int64 value)
+            {
+                Separate();
+                char digits[20];
+                auto magnitude = value < 0 ? uint64(0) - uint64(value) : uint64(value);
+                auto p = digits + sizeof digits;
+                do
+                {
+                    *--p = char('0' + magnitude % 10);
+                    magnitude /= 10;
+                } while (magnitude);
+                if (value < 0) { out.push_back('-'); }
+                out.append(p, size_t(digits + sizeof digits - p));
+                separate = true;
+                return *this;
+            }
+
+            JsonWriter& Bool(bool value)
+            {
+                Separate();
+                out += value ? "true" : "false";
+                separate = true;
+                return *this;
+            }
+
+            JsonWriter& Null()
+            {
+                Separate();
+                out += "null";
+                separate = true;
+                return *this;
+            }
+
+            JsonWriter& String(const StringView& value)
+            {
+                static const char HEX[] = "0123456789abcdef";
+                Separate();
+                out.push_back('"');
+                for (size_t i = 0; i < value.Size; ++i)
+                {
+                    auto c = value.Data[i];
+                    switch (c)
+                    {
+                        case '"': out += "\\\""; break;
+                        case '\\': out += "\\\\"; break;
+                        case '\n': out += "\\n"; break;
+                        case '\r': out += "\\r"; break;
+                        case '\t': out += "\\t"; break;
+                        default:
+                            if (static_cast<unsigned char>(c) < 0x20)
+                            {
+                                out += "\\u00";
+                                out.push_back(HEX[(c >> 4) & 0xF]);
+                                out.push_back(HEX[c & 0xF]);
+                            }
+                            else
+                            {
+                                out.push_back(c);
+                            }
+                            break;
+                    }
+                }
+                out.push_back('"');
+                separate = true;
+                return *this;
+            }
+
+            // A value that is JSON already, such as a request's id
+            JsonWriter& Raw(const StringView& json)
+            {
+                Separate();
+                out.append(json.Data, json.Size);
+                separate = true;
+                return *this;
+            }
+
+        private:
+            void Separate()
+            {
+                if (separate) { out.push_back(','); }
+            }
+
+            std::string& out;
+            bool separate;
+        };
+    }
+}
+
+#endif /* __nim_json_hpp__ */
@@ -0,0 +1,262 @@
+/*
+ * output.hpp
+ *
+ * Frame-buffered console output: everything a command prints, color escapes
+ * included, collects in memory and goes out with a single write() when the
+ * stream is flushed, instead of a trip through the C stream for every <<.
+ * Frames can also be handed to a writer thread, so a stalled terminal or
+ * pipe holds up the game only once its bounded queue is full.
+ */
+
+#ifndef __nim_output_hpp__
+#define __nim_output_hpp__
+
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace nim
+{
+    namespace detail
+    {
+        // Writes all of data to fd, retrying short writes. False on an error.
+        inline bool WriteAll(int fd, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+                auto count = ::_write(fd, data, unsigned(size));
+#else
+                auto count = ::write(fd, data, size);
+#endif
+                if (count > 0)
+                {
+                    data += count;
+                    size -= size_t(count);
+                }
+                else if (!(count < 0 && errno == EINTR))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Output thread fed through a single-producer/single-consumer byte
+        // ring. The producer and the writer only share the two positions;
+        // the mutex and condition variable come in only when one side has
+        // to sleep (empty ring, or full ring). A full ring blocks the
+        // producer until the writer catches up, so memory stays at
+        // RING_SIZE however slow fd is.
+        class AsyncWriter
+        {
+        public:
+            static const size_t RING_SIZE = 1 << 20;
+
+            explicit AsyncWriter(int fd) : fd(fd), ring(RING_SIZE), head(0), tail(0), stop(false), waiters(0)
+            {
+                thread = std::thread(&AsyncWriter::Run, this);
+            }
+
+            // Writes out everything still queued before returning
+            ~AsyncWriter()
+            {
+                stop.store(true);
+                Wake();
+                thread.join();
+            }
+
+            AsyncWriter(const AsyncWriter&) = delete;
+            AsyncWriter& operator =(const AsyncWriter&) = delete;
+
+            // Queues data, waiting for room whenever the ring is full
+            void Write(const char* data, size_t size)
+            {
+                while (size > 0)
+                {
+                    auto end = tail.load(std::memory_order_relaxed);
+                    auto room = RING_SIZE - (end - head.load(std::memory_order_acquire));
+                    if (room == 0)
+                    {
+                        Sleep([this, end] { return head.load() != end - RING_SIZE; });
+                        continue;
+                    }
+                    auto at = end % RING_SIZE;
+                    auto count = std::min(std::min(room, RING_SIZE - at), size);
+                    std::memcpy(ring.data() + at, data, count);
+                    tail.store(end + count);
+                    Wake();
+                    data += count;
+                    size -= count;
+                }
+            }
+
+        private:
+            void Run()
+            {
+                for (;;)
+                {
+                    auto begin = head.load(std::memory_order_relaxed);
+                    auto end = tail.load(std::memory_order_acquire);
+                    if (begin == end)
+                    {
+                        if (stop.load()) { return; }
+                        Sleep([this, begin] { return tail.load() != begin || stop.load(); });
+                        continue;
+                    }
+                    auto at = begin % RING_SIZE;
+                    auto count = std::min(end - begin, RING_SIZE - at);
+                    // nothing to be done about errors from here: the bytes
+                    // are dropped either way
+                    WriteAll(fd, ring.data() + at, count);
+                    head.store(begin + count);
+                    Wake();
+                }
+            }
+
+            // Blocks until ready() holds. waiters is raised before ready() is
+            // checked and read after the other side moves its position (both
+            // sequentially consistent), so a wake-up cannot be missed. It is a
+            // count since one side may still be leaving Sleep while the other
+            // enters it.
+            template <typename Ready>
+            void Sleep(Ready ready)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                waiters.fetch_add(1);
+                while (!ready())
+                {
+                    condition.wait(lock);
+                }
+                waiters.fetch_sub(1);
+            }
+
+            void Wake()
+            {
+                if (waiters.load() != 0)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    condition.notify_all();
+                }
+            }
+
+            int fd;
+            std::vector<char> ring;
+            std::atomic<size_t> head;       // next byte to write out
+            std::atomic<size_t> tail;       // next free byte
+            std::atomic<bool> stop;
+            std::atomic<int> waiters;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::thread thread;
+        };
+
+        // Takes over os for its lifetime and writes to fd directly. A frame
+        // ends when os is flushed (the console does that before it waits for
+        // input) or when it reaches FRAME_LIMIT, which bounds its memory.
+        class FrameBuffer : public std::streambuf
+        {
+        public:
+            static const size_t FRAME_LIMIT = 1 << 16;
+
+            // With an async writer, frames are queued on it instead of written
+            FrameBuffer(std::ostream& os, int fd, AsyncWriter* async = nullptr) : os(os), fd(fd), async(async)
+            {
+                // whatever the old buffer holds goes first
+                os.flush();
+                previous = os.rdbuf(this);
+                frame.reserve(FRAME_LIMIT);
+            }
+
+            ~FrameBuffer()
+            {
+                Flush();
+                os.rdbuf(previous);
+            }
+
+            // Writes out (or queues) the frame. On an error the frame is
+            // dropped, as there is nowhere else to show it.
+            bool Flush()
+            {
+                auto ok = true;
+                if (async)
+                {
+                    async->Write(frame.data(), frame.size());
+                }
+                else
+                {
+                    ok = WriteAll(fd, frame.data(), frame.size());
+                }
+                frame.clear();
+                return ok;
+            }
+
+        protected:
+            virtual int_type overflow(int_type c) override
+            {
+                if (traits_type::eq_int_type(c, traits_type::eof())) { return traits_type::not_eof(c); }
+                frame.push_back(traits_type::to_char_type(c));
+                if (frame.size() >= FRAME_LIMIT && !Flush()) { return traits_type::eof(); }
+                return c;
+            }
+
+            virtual std::streamsize xsputn(const char* s, std::streamsize n) override
+            {
+                frame.append(s, size_t(n));
+                if (frame.size() >= FRAME_LIMIT && !Flush()) { return 0; }
+                return n;
+            }
+
+            virtual int sync() override
+            {
+                return Flush() ? 0 : -1;
+            }
+
+        private:
+            std::ostream& os;
+            int fd;
+            AsyncWriter* async;
+            std::streambuf* previous;
+            std::string frame;
+        };
+
+        // Appends everything written to whichever string Target points at,
+        // for output that is sent somewhere other than a file descriptor
+        class AppendBuffer : public std::streambuf
+        {
+        public:
+            std::string* Target = nullptr;
+
+        protected:
+            virtual int_type overflow(int_type c) override
+            {
+                if (!traits_type::eq_int_type(c, traits_type::eof()))
+                {
+                    Target->push_back(traits_type::to_char_type(c));
+                }
+                return traits_type::not_eof(c);
+            }
+
+            virtual std::streamsize xsputn(const char* s, std::streamsize n) override
+            {
+                Target->append(s, size_t(n));
+                return n;
+            }
+        };
+    }
+}
+
+#endif /* __nim_output_hpp__ */
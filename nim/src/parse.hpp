@@ -8,160 +8,283 @@
 #ifndef __number_utils_parse_hpp__
 #define __number_utils_parse_hpp__
 
+#include <cfloat>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "parse_pow5.hpp"
 
 namespace numerics
 {
 
 /**
- * Parses a null-terminated string of an integral value in base 10.
- *
- * @param str the string to parse
- * @param holder a pointer of where the parsed value should be placed
- * @param integral_t the data type
- *
- * @return if parsing was successful
+ * Error code of from_chars.
  */
-template <class intregral_t>
-bool parse_integral(const char* const str, intregral_t* const holder)
+enum class parse_errc
 {
-    // quick return false on empty string
-    if (!str)
-    {
-        return false;
-    }
-    // the final value
-    intregral_t value = 0;
-    // the first char
-    char first = str[0];
-    bool isNegative = first == '-';
+    ok = 0,
+    invalid_argument,       // no digits where a number was expected
+    result_out_of_range     // the number does not fit the type
+};
 
-    int i = 0;
-    bool i_inc = isNegative || first == '+';
-    if (i_inc)
-    {
-        // if string has a leading '+' or '-', account for it and move on
-        i++;
-    }
-    for (;; ++i)
+/**
+ * Result of from_chars: where parsing stopped and whether it succeeded.
+ */
+struct from_chars_result
+{
+    const char* ptr;
+    parse_errc ec;
+};
+
+namespace internal
+{
+
+// SWAR conversion works on 8 bytes loaded little-endian
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+#define NUMERICS_SWAR_DIGITS 1
+#else
+#define NUMERICS_SWAR_DIGITS 0
+#endif
+
+/**
+ * Whether the 8 bytes in chunk (loaded little-endian) are all '0'-'9'.
+ */
+inline bool is_eight_digits(std::uint64_t chunk)
+{
+    // high nibbles must be 3, and adding 6 must not carry into them
+    return ((chunk & 0xF0F0F0F0F0F0F0F0ull) |
+            (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+/**
+ * Value of 8 decimal digits (loaded little-endian, first digit in the low
+ * byte) in three multiplies: pairs, then quads, then the whole.
+ */
+inline std::uint32_t eight_digits_value(std::uint64_t chunk)
+{
+    chunk -= 0x3030303030303030ull;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+             (((chunk >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return std::uint32_t(chunk);
+}
+
+inline unsigned digit_value(char c)
+{
+    if (c >= '0' && c <= '9') { return unsigned(c - '0'); }
+    if (c >= 'a' && c <= 'z') { return unsigned(c - 'a' + 10); }
+    if (c >= 'A' && c <= 'Z') { return unsigned(c - 'A' + 10); }
+    return 36;
+}
+
+/**
+ * Parses the digits in [first, last) as the magnitude of a number of
+ * integral_t, negated if negative. Stops at the first char that is not a
+ * digit in base. value is only written on success.
+ */
+template <class integral_t>
+from_chars_result parse_digits(const char* first, const char* last, bool negative,
+        integral_t& value, const unsigned base)
+{
+    typedef typename std::make_unsigned<integral_t>::type unsigned_t;
+
+    // largest magnitude the sign allows
+    const unsigned_t max_mag = std::is_signed<integral_t>::value ?
+        unsigned_t(unsigned_t(std::numeric_limits<integral_t>::max()) + (negative ? 1 : 0)) :
+        std::numeric_limits<unsigned_t>::max();
+    // mag * base + digit overflows iff mag > cutoff, or mag == cutoff and digit > cutlim
+    const unsigned_t cutoff = max_mag / base;
+    const unsigned cutlim = unsigned(max_mag % base);
+
+    unsigned_t mag = 0;
+    bool overflow = false;
+    const char* p = first;
+
+#if NUMERICS_SWAR_DIGITS
+    if (base == 10 && sizeof(unsigned_t) >= 4)
     {
-        char c = str[i];
-        if (!c)
+        while (last - p >= 8)
         {
-            // if the number is empty, like "", "+" or "-" return false
-            if (i == (i_inc ? 1 : 0))
+            std::uint64_t chunk;
+            std::memcpy(&chunk, p, 8);
+            if (!is_eight_digits(chunk)) { break; }
+            const unsigned_t digits = unsigned_t(eight_digits_value(chunk));
+            const unsigned_t scale = unsigned_t(100000000u);
+            if (!overflow && (mag > (max_mag - digits) / scale))
             {
-                return false;
+                overflow = true;
             }
-            // otherwise, we've reached the end of the string,
-            // set value and return true
-            *holder = (intregral_t) (isNegative ? -value : value);
-            return true;
+            mag = unsigned_t(mag * scale + digits);
+            p += 8;
         }
+    }
+#endif
 
-        // quickly, if c = 0, multiply by 10 and continue
-        if (c == '0')
+    for (; p != last; ++p)
+    {
+        const unsigned digit = digit_value(*p);
+        if (digit >= base) { break; }
+        if (mag > cutoff || (mag == cutoff && digit > cutlim))
         {
-            value *= 10;
-            continue;
+            overflow = true;
         }
+        mag = unsigned_t(mag * base + digit);
+    }
 
-        // get the numeric equivalent of the char
-        int val = (int) (c - '0');
-        // if the value is outside the range of base 10, return false
-        if (val < 0 || val > 9)
-        {
-            return false;
-        }
-        // add next digit to value
-        value = value * 10 + val;
+    if (p == first)
+    {
+        return { first, parse_errc::invalid_argument };
+    }
+    if (overflow)
+    {
+        return { p, parse_errc::result_out_of_range };
+    }
+    if (negative)
+    {
+        // -(mag - 1) - 1 stays representable even for the minimum value
+        value = mag == 0 ? integral_t(0) : integral_t(-integral_t(mag - 1) - 1);
     }
+    else
+    {
+        value = integral_t(mag);
+    }
+    return { p, parse_errc::ok };
+}
 
-    // if it reached here, something went wrong, return false
-    return false;
+/**
+ * Skips an optional leading '+' or '-'; '-' is only valid for signed types.
+ */
+template <class integral_t>
+bool parse_sign(const char*& p, const char* last, bool& negative)
+{
+    negative = false;
+    if (p != last && (*p == '+' || *p == '-'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+    return !negative || std::is_signed<integral_t>::value;
+}
+
+/**
+ * Runs parse on a whole null-terminated string: true only if it parsed
+ * without error and consumed every char.
+ */
+template <class parse_t>
+bool parse_whole(const char* const str, parse_t parse)
+{
+    if (!str)
+    {
+        return false;
+    }
+    const char* last = str + std::strlen(str);
+    from_chars_result result = parse(str, last);
+    return result.ec == parse_errc::ok && result.ptr == last;
+}
+
+} // namespace internal
+
+/**
+ * Parses an integral value from [first, last) in the style of
+ * std::from_chars: an optional sign ('-' for signed types only) followed by
+ * digits of base (2 to 36, letters in either case). Parsing stops at the
+ * first char that is not a digit and returns a pointer to it.
+ *
+ * On success, ec is parse_errc::ok and value holds the result. If there are
+ * no digits, ec is invalid_argument and ptr is first; if the number does not
+ * fit integral_t, ec is result_out_of_range and ptr is past its digits. In
+ * both cases value is left untouched.
+ *
+ * Base 10 converts 8 digits at a time (SWAR) while it can.
+ */
+template <class integral_t>
+typename std::enable_if<std::is_integral<integral_t>::value, from_chars_result>::type
+from_chars(const char* const first, const char* const last,
+        integral_t& value, const unsigned int base = 10)
+{
+    if (base < 2 || base > 36)
+    {
+        return { first, parse_errc::invalid_argument };
+    }
+    const char* p = first;
+    bool negative;
+    if (!internal::parse_sign<integral_t>(p, last, negative))
+    {
+        return { first, parse_errc::invalid_argument };
+    }
+    from_chars_result result = internal::parse_digits(p, last, negative, value, base);
+    if (result.ec == parse_errc::invalid_argument)
+    {
+        result.ptr = first;
+    }
+    return result;
+}
+
+/**
+ * Parses a null-terminated string of an integral value in base 10.
+ *
+ * @param str the string to parse
+ * @param holder a pointer of where the parsed value should be placed
+ * @param integral_t the data type
+ *
+ * @return if parsing was successful (false as well if the value does not fit
+ * the type)
+ */
+template <class intregral_t>
+bool parse_integral(const char* const str, intregral_t* const holder)
+{
+    return internal::parse_whole(str, [holder](const char* first, const char* last)
+    {
+        return from_chars(first, last, *holder);
+    });
 }
 
 /**
  * Parses a null-terminated string of an integral value in the specified base.
- * Possible valid chars include numbers 0-9, and values greater than 'A' for bases
- * greater than 10.
+ * Possible valid chars include numbers 0-9, and letters (of either case) for
+ * bases greater than 10.
  *
  * @param str the string to parse
  * @param holder a pointer of where the parsed value should be placed
  * @param base the base to parse in
  * @param integral_t the data type
  *
- * @return if parsing was successful
+ * @return if parsing was successful (false as well if the value does not fit
+ * the type)
  */
 template <class intregral_t>
 bool parse_integral(const char* const str, intregral_t* const holder,
         const unsigned int base)
 {
-    // quick check for empty string or base 0 or 1
-    if (base < 2 || !str)
+    return internal::parse_whole(str, [holder, base](const char* first, const char* last)
     {
-        return false;
-    }
-    // the final value
-    intregral_t value = 0;
-    // the first char
-    char first = str[0];
-    bool isNegative = first == '-';
-    int i = 0;
-    bool i_inc = isNegative || first == '+';
-    if (i_inc)
+        return from_chars(first, last, *holder, base);
+    });
+}
+
+/**
+ * Parses a prefixed ("0x", "0b") integral value in [first, last): the prefix
+ * comes after the optional sign.
+ */
+template <class intregral_t>
+from_chars_result from_chars_prefixed(const char* const first, const char* const last,
+        intregral_t& value, const char prefix, const unsigned int base)
+{
+    const char* p = first;
+    bool negative;
+    if (!internal::parse_sign<intregral_t>(p, last, negative) ||
+        last - p < 2 || p[0] != '0' || p[1] != prefix)
     {
-        // if string has a leading '+' or '-', account for it and move on
-        i++;
+        return { first, parse_errc::invalid_argument };
     }
-    for (;; ++i)
+    from_chars_result result = internal::parse_digits(p + 2, last, negative, value, base);
+    if (result.ec == parse_errc::invalid_argument)
     {
-        char c = str[i];
-        if (!c)
-        {
-            // if the number is empty, like "", "+" or "-" return false
-            if (i == i_inc ? 1 : 0)
-            {
-                return false;
-            }
-            // otherwise, we've reached the end of the string,
-            // set the value and return true
-            *holder = (intregral_t) (isNegative ? -value : value);
-            return true;
-        }
-
-        // if 0, shift digits and continue
-        if (c == '0')
-        {
-            value *= base;
-            continue;
-        }
-
-        // if string contains any symbols between '9' and 'A' return false
-        if (c > 57 && c < 65)
-        {
-            return false;
-        }
-
-        int val = (int) (c - '0');
-        // so account for the ignored value, we must subtract
-        if (val > 9)
-        {
-            val -= 7;
-        }
-
-        // if any digit is outside the base's range, return false
-        if (val < 0 || val > base - 1)
-        {
-            return false;
-        }
-
-        // add next digit
-        value = value * base + val;
+        result.ptr = first;
     }
-
-    // if it reached here, then it failed, return false
-    return false;
+    return result;
 }
 
 /**
@@ -178,138 +301,737 @@ bool parse_integral(const char* const str, intregral_t* const holder,
 template <class intregral_t>
 bool parse_hex(const char* const str, intregral_t* const holder)
 {
-    // quick check for empty string
-    if (!str)
+    return internal::parse_whole(str, [holder](const char* first, const char* last)
     {
-        return false;
+        return from_chars_prefixed(first, last, *holder, 'x', 16);
+    });
+}
+
+/**
+ * Parses a null-terminated string of an integral value in binary.
+ * Valid values include 0 and 1. The string must be in the form [+/-]0b[xx...].
+ *
+ * @param str the string to parse
+ * @param holder a pointer of where the parsed value should be placed
+ * @param integral_t the data type
+ *
+ * @return if parsing was successful
+ */
+template <class intregral_t>
+bool parse_bin(const char* const str, intregral_t* const holder)
+{
+    return internal::parse_whole(str, [holder](const char* first, const char* last)
+    {
+        return from_chars_prefixed(first, last, *holder, 'b', 2);
+    });
+}
+
+namespace internal
+{
+
+/**
+ * Layout of an IEEE-754 binary format, plus the bounds the conversions
+ * below rely on.
+ */
+template <class fp_t>
+struct binary_format;
+
+template <>
+struct binary_format<double>
+{
+    typedef std::uint64_t bits_t;
+    static const int mantissa_bits = 52;
+    static const int exponent_bits = 11;
+    static const int minimum_exponent = -1023;
+    static const int infinite_power = 0x7FF;
+    // decimal exponents outside these always give zero or infinity
+    static const int smallest_power_of_ten = -342;
+    static const int largest_power_of_ten = 308;
+    // exact halfway cases can only occur for these decimal exponents
+    static const int min_exponent_round_to_even = -4;
+    static const int max_exponent_round_to_even = 23;
+    // Clinger's fast path: mantissa and 10^|q| both exact in a double
+    static const int max_exact_power_of_ten = 22;
+    static const std::uint64_t max_exact_mantissa = std::uint64_t(1) << 53;
+
+    static double exact_power_of_ten(int q)
+    {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        return powers[q];
+    }
+};
+
+template <>
+struct binary_format<float>
+{
+    typedef std::uint32_t bits_t;
+    static const int mantissa_bits = 23;
+    static const int exponent_bits = 8;
+    static const int minimum_exponent = -127;
+    static const int infinite_power = 0xFF;
+    static const int smallest_power_of_ten = -65;
+    static const int largest_power_of_ten = 38;
+    static const int min_exponent_round_to_even = -17;
+    static const int max_exponent_round_to_even = 10;
+    static const int max_exact_power_of_ten = 10;
+    static const std::uint64_t max_exact_mantissa = std::uint64_t(1) << 24;
+
+    static float exact_power_of_ten(int q)
+    {
+        static const float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+        return powers[q];
     }
-    // the first char
-    char first = str[0];
-    bool isNegative = first == '-';
-    int i = 0;
-    bool i_inc = isNegative || first == '+';
-    if (i_inc)
+};
+
+/**
+ * A binary floating point value before packing: mantissa without the
+ * implicit bit, and biased exponent. power2 < 0 means "could not decide".
+ */
+struct adjusted_mantissa
+{
+    std::uint64_t mantissa;
+    int power2;
+};
+
+template <class fp_t>
+fp_t to_float(bool negative, const adjusted_mantissa& am)
+{
+    typedef binary_format<fp_t> format;
+    typedef typename format::bits_t bits_t;
+    bits_t bits = bits_t(am.mantissa) | (bits_t(am.power2) << format::mantissa_bits);
+    if (negative)
     {
-        // if string has a leading '+' or '-', account for it and move on
-        i++;
+        bits |= bits_t(1) << (format::mantissa_bits + format::exponent_bits);
     }
-    // hex string must start with "0x"
-    if (str[i] != '0' || str[i + 1] != 'x')
+    fp_t value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline int leading_zeroes(std::uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    for (std::uint64_t bit = std::uint64_t(1) << 63; !(x & bit); bit >>= 1)
     {
-        return false;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Full 64x64 -> 128 bit product.
+ */
+inline void full_multiplication(std::uint64_t a, std::uint64_t b, std::uint64_t& high, std::uint64_t& low)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 product = uint128(a) * b;
+    high = std::uint64_t(product >> 64);
+    low = std::uint64_t(product);
+#else
+    std::uint64_t a_lo = std::uint32_t(a), a_hi = a >> 32;
+    std::uint64_t b_lo = std::uint32_t(b), b_hi = b >> 32;
+    std::uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    std::uint64_t cross = (lo_lo >> 32) + std::uint32_t(hi_lo) + lo_hi;
+    high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    low = (cross << 32) | std::uint32_t(lo_lo);
+#endif
+}
+
+/**
+ * Eisel-Lemire: w * 10^q rounded to nearest (even) from a 128-bit
+ * approximation of 5^q. Returns power2 = -1 in the (provably rare) cases
+ * where the approximation cannot tell which way to round.
+ */
+template <class fp_t>
+adjusted_mantissa eisel_lemire(std::int64_t q, std::uint64_t w)
+{
+    typedef binary_format<fp_t> format;
+    adjusted_mantissa answer = { 0, 0 };
+    if (w == 0 || q < format::smallest_power_of_ten)
+    {
+        return answer;
     }
-    intregral_t value = 0;
-    for (;; ++i)
+    if (q > format::largest_power_of_ten)
     {
-        char c = str[i + 2];
-        if (!c)
+        answer.power2 = format::infinite_power;
+        return answer;
+    }
+
+    const int lz = leading_zeroes(w);
+    w <<= lz;
+
+    // enough bits for the mantissa plus rounding, with a second word of
+    // 5^q only if the first leaves them undetermined
+    const int index = 2 * int(q - pow5_128<>::smallest_power);
+    std::uint64_t high, low;
+    full_multiplication(w, pow5_128<>::table[index], high, low);
+    const std::uint64_t precision_mask = ~std::uint64_t(0) >> (format::mantissa_bits + 3);
+    if ((high & precision_mask) == precision_mask)
+    {
+        std::uint64_t second_high, second_low;
+        full_multiplication(w, pow5_128<>::table[index + 1], second_high, second_low);
+        low += second_high;
+        if (second_high > low)
         {
-            if (i == (i_inc ? 1 : 0))
+            ++high;
+        }
+    }
+    if (low == ~std::uint64_t(0) && (q < -27 || q > 55))
+    {
+        // 5^q was truncated; the true product may carry into high
+        answer.power2 = -1;
+        return answer;
+    }
+
+    const int upperbit = int(high >> 63);
+    const int shift = upperbit + 64 - format::mantissa_bits - 3;
+    answer.mantissa = high >> shift;
+    // floor(log2(10^q)) = floor(q * log2(10)), exact over this range
+    answer.power2 = int(((152170 + 65536) * q) >> 16) + 63 + upperbit - lz - format::minimum_exponent;
+
+    if (answer.power2 <= 0)
+    {
+        // subnormal: shift down to the fixed exponent, then round
+        if (-answer.power2 + 1 >= 64)
+        {
+            answer.mantissa = 0;
+            answer.power2 = 0;
+            return answer;
+        }
+        answer.mantissa >>= -answer.power2 + 1;
+        answer.mantissa += (answer.mantissa & 1);
+        answer.mantissa >>= 1;
+        // rounding up may have made it the smallest normal
+        answer.power2 = (answer.mantissa < (std::uint64_t(1) << format::mantissa_bits)) ? 0 : 1;
+        return answer;
+    }
+
+    // exactly halfway between two floats: round to even instead of up
+    if (low <= 1 && q >= format::min_exponent_round_to_even && q <= format::max_exponent_round_to_even &&
+        (answer.mantissa & 3) == 1 && (answer.mantissa << shift) == high)
+    {
+        answer.mantissa &= ~std::uint64_t(1);
+    }
+
+    answer.mantissa += (answer.mantissa & 1);
+    answer.mantissa >>= 1;
+    if (answer.mantissa >= (std::uint64_t(2) << format::mantissa_bits))
+    {
+        answer.mantissa = std::uint64_t(1) << format::mantissa_bits;
+        ++answer.power2;
+    }
+    answer.mantissa &= ~(std::uint64_t(1) << format::mantissa_bits);
+    if (answer.power2 >= format::infinite_power)
+    {
+        answer.power2 = format::infinite_power;
+        answer.mantissa = 0;
+    }
+    return answer;
+}
+
+/**
+ * Arbitrary-precision decimal for the slow path ("simple decimal
+ * conversion"): scaled by powers of two until it is in [0.5, 1), then the
+ * mantissa bits are shifted out and rounded. Exact, but a few microseconds.
+ */
+struct decimal
+{
+    static const int max_digits = 800;
+    // largest shift that cannot overflow the 64-bit accumulator
+    static const int max_shift = 60;
+
+    unsigned char digits[max_digits];   // values 0-9, most significant first
+    int count;              // digits in use
+    int point;              // value = 0.digits * 10^point
+    bool truncated;         // nonzero digits were dropped past max_digits
+
+    decimal() : count(0), point(0), truncated(false) {}
+
+    void append(char c)
+    {
+        if (count == 0 && c == '0')
+        {
+            // leading zero: only moves the point
+            --point;
+        }
+        else if (count < max_digits)
+        {
+            digits[count++] = (unsigned char)(c - '0');
+        }
+        else if (c != '0')
+        {
+            truncated = true;
+        }
+    }
+
+    void trim()
+    {
+        while (count > 0 && digits[count - 1] == 0)
+        {
+            --count;
+        }
+        if (count == 0)
+        {
+            point = 0;
+        }
+    }
+
+    void shift_right(int k)
+    {
+        int read = 0, write = 0;
+        std::uint64_t n = 0;
+        // pick up enough leading digits to cover the first shift
+        for (; (n >> k) == 0; ++read)
+        {
+            if (read >= count)
             {
-                // if the number is empty, like "", "+" or "-" return false
-                return false;
+                if (n == 0)
+                {
+                    count = 0;
+                    return;
+                }
+                while ((n >> k) == 0)
+                {
+                    n *= 10;
+                    ++read;
+                }
+                break;
             }
-            *holder = (intregral_t) (isNegative ? -value : value);
-            return true;
+            n = n * 10 + digits[read];
         }
+        point -= read - 1;
 
-        // if c = 0, shift digit and move on
-        if (c == '0')
+        const std::uint64_t mask = (std::uint64_t(1) << k) - 1;
+        for (; read < count; ++read)
         {
-            value *= 16;
-            continue;
+            digits[write++] = (unsigned char)(n >> k);
+            n = (n & mask) * 10 + digits[read];
+        }
+        while (n > 0)
+        {
+            const std::uint64_t digit = n >> k;
+            n = (n & mask) * 10;
+            if (write < max_digits)
+            {
+                digits[write++] = (unsigned char)digit;
+            }
+            else if (digit > 0)
+            {
+                truncated = true;
+            }
         }
+        count = write;
+        trim();
+    }
 
-        // if c is a symbol between '9' and 'A' return false
-        if (c > 57 && c < 65)
+    void shift_left(int k)
+    {
+        // multiply from the least significant digit into a scratch buffer
+        // that has room for the up to 19 new digits in front
+        unsigned char result[max_digits + 20];
+        int write = max_digits + 20;
+        std::uint64_t n = 0;
+        for (int read = count - 1; read >= 0; --read)
         {
-            return false;
+            n += std::uint64_t(digits[read]) << k;
+            const std::uint64_t quotient = n / 10;
+            result[--write] = (unsigned char)(n - 10 * quotient);
+            n = quotient;
+        }
+        while (n > 0)
+        {
+            const std::uint64_t quotient = n / 10;
+            result[--write] = (unsigned char)(n - 10 * quotient);
+            n = quotient;
+        }
+        const int new_count = max_digits + 20 - write;
+        point += new_count - count;
+        count = new_count < max_digits ? new_count : max_digits;
+        for (int i = count; i < new_count; ++i)
+        {
+            if (result[write + i] != 0)
+            {
+                truncated = true;
+            }
         }
+        std::memcpy(digits, result + write, size_t(count));
+        trim();
+    }
 
-        // if c is a small letter, lower the value into the range
-        if (c > 96)
+    void shift(int k)
+    {
+        if (count == 0)
         {
-            c -= 39;
+            return;
         }
-        // or if c is a capital, lower the value but by less
-        else if (c > 64)
+        if (k > 0)
         {
-            c -= 7;
+            for (; k > max_shift; k -= max_shift)
+            {
+                shift_left(max_shift);
+            }
+            shift_left(k);
         }
+        else if (k < 0)
+        {
+            for (; k < -max_shift; k += max_shift)
+            {
+                shift_right(max_shift);
+            }
+            shift_right(-k);
+        }
+    }
 
-        int val = (int) (c - '0');
-        // if the value is outside the hex digits range, return false
-        if (val < 0 || val > 15)
+    bool should_round_up(int nd) const
+    {
+        if (nd < 0 || nd >= count)
         {
             return false;
         }
+        if (digits[nd] == 5 && nd + 1 == count)
+        {
+            // exactly halfway (unless digits were dropped): round to even
+            return truncated || (nd > 0 && (digits[nd - 1] & 1));
+        }
+        return digits[nd] >= 5;
+    }
 
-        // add next digit
-        value = value * 16 + val;
+    std::uint64_t rounded_integer() const
+    {
+        if (point > 20)
+        {
+            return ~std::uint64_t(0);
+        }
+        std::uint64_t n = 0;
+        int i = 0;
+        for (; i < point && i < count; ++i)
+        {
+            n = n * 10 + digits[i];
+        }
+        for (; i < point; ++i)
+        {
+            n *= 10;
+        }
+        return should_round_up(point) ? n + 1 : n;
     }
 
-    // if it got here, then something went wrong, return false
-    return false;
+    template <class fp_t>
+    adjusted_mantissa to_binary()
+    {
+        typedef binary_format<fp_t> format;
+        // bits gained or lost by a shift that moves the point by 1..8 digits
+        static const int power_table[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+        static const int power_table_size = 9;
+        const int bias = format::minimum_exponent;
+
+        adjusted_mantissa answer = { 0, 0 };
+        trim();
+        if (count == 0 || point < -330)
+        {
+            return answer;
+        }
+        if (point > 310)
+        {
+            answer.power2 = format::infinite_power;
+            return answer;
+        }
+
+        // scale into [0.5, 1), keeping track of the binary exponent
+        int exp2 = 0;
+        while (point > 0)
+        {
+            const int n = point >= power_table_size ? 27 : power_table[point];
+            shift(-n);
+            exp2 += n;
+        }
+        while (point < 0 || (point == 0 && digits[0] < 5))
+        {
+            const int n = -point >= power_table_size ? 27 : power_table[-point];
+            shift(n);
+            exp2 -= n;
+        }
+        // [0.5, 1) to the [1, 2) of a normal float
+        --exp2;
+
+        if (exp2 < bias + 1)
+        {
+            // subnormal: fix the exponent at the minimum, shift the rest
+            const int n = bias + 1 - exp2;
+            shift(-n);
+            exp2 += n;
+        }
+        if (exp2 - bias >= format::infinite_power)
+        {
+            answer.power2 = format::infinite_power;
+            return answer;
+        }
+
+        shift(1 + format::mantissa_bits);
+        std::uint64_t mantissa = rounded_integer();
+        if (mantissa == (std::uint64_t(2) << format::mantissa_bits))
+        {
+            // rounding carried into a new bit
+            mantissa >>= 1;
+            ++exp2;
+            if (exp2 - bias >= format::infinite_power)
+            {
+                answer.power2 = format::infinite_power;
+                return answer;
+            }
+        }
+        if (!(mantissa & (std::uint64_t(1) << format::mantissa_bits)))
+        {
+            exp2 = bias;
+        }
+        answer.mantissa = mantissa & ((std::uint64_t(1) << format::mantissa_bits) - 1);
+        answer.power2 = exp2 - bias;
+        return answer;
+    }
+};
+
+/**
+ * The syntax of a decimal number, split up once so that the fast and the
+ * slow path can both work from it.
+ */
+struct decimal_parts
+{
+    std::uint64_t mantissa;     // first 19 significant digits
+    std::int64_t exponent;      // value ~ mantissa * 10^exponent
+    bool truncated;             // nonzero digits beyond the 19
+    const char* digits_begin;   // [digits_begin, digits_end) holds digits and at most one '.'
+    const char* digits_end;
+    std::int64_t explicit_exponent;
+};
+
+inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
 }
 
 /**
- * Parses a null-terminated string of an integral value in binary.
- * Valid values include 0 and 1. The string must be in the form [+/-]0b[xx...].
- *
- * @param str the string to parse
- * @param holder a pointer of where the parsed value should be placed
- * @param integral_t the data type
- *
- * @return if parsing was successful
+ * [+/-]digits[.digits][e/E[+/-]digits] with at least one digit in the
+ * mantissa; the point may come first or last. An 'e' that is not followed
+ * by an exponent ends the number before it.
  */
-template <class intregral_t>
-bool parse_bin(const char* const str, intregral_t* const holder)
+inline const char* parse_decimal(const char* p, const char* last, decimal_parts& parts)
 {
-    if (!str)
+    static const int max_digits = 19;
+
+    parts.mantissa = 0;
+    parts.exponent = 0;
+    parts.truncated = false;
+    parts.digits_begin = p;
+    parts.explicit_exponent = 0;
+
+    int significant = 0;
+    bool any_digit = false;
+    for (; p != last && is_digit(*p); ++p)
     {
-        return false;
+        any_digit = true;
+        if (significant < max_digits)
+        {
+            if (parts.mantissa != 0 || *p != '0')
+            {
+                parts.mantissa = parts.mantissa * 10 + std::uint64_t(*p - '0');
+                ++significant;
+            }
+        }
+        else
+        {
+            ++parts.exponent;
+            parts.truncated |= (*p != '0');
+        }
     }
-    char first = str[0];
-    bool isNegative = first == '-';
-    int i = 0;
-    bool i_inc = isNegative || first == '+';
-
-    if (i_inc)
+    if (p != last && *p == '.')
     {
-        i++;
+        ++p;
+        for (; p != last && is_digit(*p); ++p)
+        {
+            any_digit = true;
+            if (significant < max_digits)
+            {
+                if (parts.mantissa != 0 || *p != '0')
+                {
+                    parts.mantissa = parts.mantissa * 10 + std::uint64_t(*p - '0');
+                    ++significant;
+                }
+                --parts.exponent;
+            }
+            else
+            {
+                parts.truncated |= (*p != '0');
+            }
+        }
     }
-    if (str[i] != '0' || str[i + 1] != 'b')
+    if (!any_digit)
     {
-        return false;
+        return nullptr;
     }
-    intregral_t value = 0;
-    for (;; ++i)
+    parts.digits_end = p;
+
+    if (p != last && (*p == 'e' || *p == 'E'))
     {
-        char c = str[i + 2];
-        if (!c)
+        const char* e = p + 1;
+        bool negative = false;
+        if (e != last && (*e == '+' || *e == '-'))
         {
-            if (i == (i_inc ? 1 : 0))
+            negative = (*e == '-');
+            ++e;
+        }
+        if (e != last && is_digit(*e))
+        {
+            std::int64_t value = 0;
+            for (; e != last && is_digit(*e); ++e)
             {
-                return false;
+                // saturate; anything this large is zero or infinity anyway
+                if (value < 0x10000000)
+                {
+                    value = value * 10 + (*e - '0');
+                }
             }
-            *holder = (intregral_t) (isNegative ? -value : value);
-            return true;
+            parts.explicit_exponent = negative ? -value : value;
+            parts.exponent += parts.explicit_exponent;
+            p = e;
         }
-        switch (c)
+    }
+    return p;
+}
+
+template <class fp_t>
+adjusted_mantissa slow_path(const decimal_parts& parts)
+{
+    decimal d;
+    bool saw_point = false;
+    for (const char* p = parts.digits_begin; p != parts.digits_end; ++p)
+    {
+        if (*p == '.')
         {
-            case 48:
-                value = value << 1;
-                break;
-            case 49:
-                value = (value << 1) + 1;
-                break;
-            default:
-                return false;
+            // leading zeros before the point do not move it, only those after
+            saw_point = true;
+            d.point = d.count;
+            continue;
         }
+        d.append(*p);
     }
-    return false;
+    if (!saw_point)
+    {
+        d.point = d.count;
+    }
+    const std::int64_t point = std::int64_t(d.point) + parts.explicit_exponent;
+    if (point > 100000 || point < -100000)
+    {
+        adjusted_mantissa answer = { 0, point > 0 ? binary_format<fp_t>::infinite_power : 0 };
+        return answer;
+    }
+    d.point = int(point);
+    return d.to_binary<fp_t>();
 }
 
+template <class fp_t>
+from_chars_result from_chars_float(const char* const first, const char* const last, fp_t& value)
+{
+    typedef binary_format<fp_t> format;
+
+    const char* p = first;
+    bool negative = false;
+    if (p != last && (*p == '+' || *p == '-'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+    decimal_parts parts;
+    const char* end = parse_decimal(p, last, parts);
+    if (!end)
+    {
+        return { first, parse_errc::invalid_argument };
+    }
+
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+    // Clinger: an exact mantissa times or over an exact power of ten is a
+    // single correctly rounded operation
+    if (!parts.truncated && parts.mantissa <= format::max_exact_mantissa &&
+        parts.exponent >= -format::max_exact_power_of_ten && parts.exponent <= format::max_exact_power_of_ten)
+    {
+        fp_t result = fp_t(parts.mantissa);
+        if (parts.exponent < 0)
+        {
+            result = result / format::exact_power_of_ten(int(-parts.exponent));
+        }
+        else
+        {
+            result = result * format::exact_power_of_ten(int(parts.exponent));
+        }
+        value = negative ? -result : result;
+        return { end, parse_errc::ok };
+    }
+#endif
+
+    adjusted_mantissa am = eisel_lemire<fp_t>(parts.exponent, parts.mantissa);
+    if (parts.truncated && am.power2 >= 0)
+    {
+        // the true value lies in (w, w + 1) * 10^q; fine if both ends agree
+        adjusted_mantissa upper = eisel_lemire<fp_t>(parts.exponent, parts.mantissa + 1);
+        if (upper.power2 != am.power2 || upper.mantissa != am.mantissa)
+        {
+            am.power2 = -1;
+        }
+    }
+    if (am.power2 < 0)
+    {
+        am = slow_path<fp_t>(parts);
+    }
+    if (am.power2 == format::infinite_power)
+    {
+        return { end, parse_errc::result_out_of_range };
+    }
+    value = to_float<fp_t>(negative, am);
+    return { end, parse_errc::ok };
+}
+
+} // namespace internal
+
+/**
+ * Parses a float from [first, last) in the style of std::from_chars: an
+ * optional sign, digits with an optional '.', and an optional exponent
+ * ([e/E][+/-]digits). The result is correctly rounded (to nearest, ties to
+ * even): exact cases take Clinger's fast path, almost everything else one
+ * or two 128-bit multiplies (Eisel-Lemire), and the rare undecidable input
+ * an exact big-decimal conversion.
+ *
+ * ec is invalid_argument (and ptr first) without digits, and
+ * result_out_of_range if the value overflows the type; value is untouched
+ * in both cases. Values too small for the type round to (signed) zero.
+ */
+inline from_chars_result from_chars(const char* const first, const char* const last, double& value)
+{
+    return internal::from_chars_float(first, last, value);
+}
+
+inline from_chars_result from_chars(const char* const first, const char* const last, float& value)
+{
+    return internal::from_chars_float(first, last, value);
+}
+
+namespace internal
+{
+
+// parse_fp goes through float or double; other types are converted from double
+template <class fp_t>
+struct fp_parse_type { typedef double type; };
+
+template <>
+struct fp_parse_type<float> { typedef float type; };
+
+} // namespace internal
+
 /**
  * Parses a null-terminated string of a decimal or exponent notation to a
  * floating point (or optionally integral) value.
@@ -319,96 +1041,21 @@ bool parse_bin(const char* const str, intregral_t* const holder)
  * @param holder a pointer of where the parsed value should be placed
  * @param fp_t the data type
  *
- * @return if parsing was successful
+ * @return if parsing was successful (false as well if the value overflows)
  */
 template <class fp_t>
 bool parse_fp(const char* const str, fp_t* const holder)
 {
-    if (!str)
-    {
-        return false;
-    }
-
-    long long value = 0;
-    char first = str[0];
-
-    bool isNegative = first == '-';
-    int i = 0;
-    bool i_inc = isNegative || first == '+';
-    if (i_inc)
+    typename internal::fp_parse_type<fp_t>::type value;
+    bool success = internal::parse_whole(str, [&value](const char* first, const char* last)
     {
-        i++;
-    }
-
-    bool exp_inc = false;
-    int pt_div_idx = -1;
-    for (;; ++i)
+        return from_chars(first, last, value);
+    });
+    if (success)
     {
-        char c = str[i];
-        if (!c)
-        {
-            if (exp_inc || (i == (i_inc ? 1 : 0)))
-            {
-                return false;
-            }
-            if (!pt_div_idx)
-            {
-                return false;
-            }
-            fp_t fp_val = (fp_t) (isNegative ? -value : value);
-            if (pt_div_idx != -1)
-            {
-                fp_val /= (fp_t) std::pow(10, pt_div_idx);
-            }
-            *holder = fp_val;
-            return true;
-        }
-        switch (c)
-        {
-            case 'e':
-            case 'E':
-                if (exp_inc || !pt_div_idx)
-                {
-                    return false;
-                }
-                exp_inc = true;
-                break;
-            case '.':
-                if (pt_div_idx > -1)
-                {
-                    return false;
-                }
-                pt_div_idx++;
-                break;
-            default:
-                int val = (int) (c - '0');
-                if (exp_inc)
-                {
-                    int exp_val;
-                    bool success = parse_integral<int>(str + i, &exp_val);
-                    if (!success) return false;
-                    fp_t fp_val = (fp_t) (isNegative ? -value : value);
-                    if (pt_div_idx > -1)
-                    {
-                        fp_val /= (fp_t) std::pow(10, pt_div_idx - exp_val);
-                    }
-                    *holder = fp_val;
-                    return true;
-                }
-                else
-                {
-                    if (pt_div_idx > -1)
-                    {
-                        pt_div_idx++;
-                    }
-                    if (val < 0 || val > 9)
-                    {
-                        return false;
-                    }
-                    value = value * 10 + val;
-                }
-        }
+        *holder = fp_t(value);
     }
+    return success;
 }
 
 }
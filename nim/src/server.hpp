@@ -0,0 +1,494 @@
+/*
+ * server.hpp
+ *
+ * Line-oriented TCP server over non-blocking sockets, where every
+ * connection has a session of its own that turns command lines into
+ * replies. Idle connections cost a socket and a few small buffers; a move
+ * costs one read and one write. The loop itself is a backend: EpollServer
+ * here, or UringServer (uring.hpp) where the kernel has io_uring.
+ *
+ * A Server is one shard: its own listening socket (SO_REUSEPORT lets every
+ * shard bind the same port and the kernel spread connections over them),
+ * its own connection table and its own pool of connection records. Run it
+ * on a thread of its own and nothing on its path is shared with the others
+ * but its counters, which only it writes. Stop, from any other thread,
+ * makes Run return.
+ */
+
+#ifndef __nim_server_hpp__
+#define __nim_server_hpp__
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <nim/nim_stdtypes.h>
+#include "command.hpp"
+
+namespace nim
+{
+    namespace detail
+    {
+        // What a connection talks to
+        class ServerSession
+        {
+        public:
+            virtual ~ServerSession() {}
+
+            // Handles one command line (without its newline), appending the
+            // reply to out. False once the session is over: the connection
+            // closes when out has been sent.
+            virtual bool Execute(const StringView& line, std::string& out) = 0;
+        };
+
+        // Makes the session of a new connection, appending its greeting to
+        // the string given
+        typedef std::function<std::unique_ptr<ServerSession>(std::string&)> SessionFactory;
+
+        // Counters of one shard. Only the shard's thread writes them, so an
+        // increment is a plain load and store; anyone may read them.
+        struct ServerStats
+        {
+            std::atomic<uint64> Accepted{ 0 };
+            std::atomic<uint64> Closed{ 0 };
+            std::atomic<uint64> Commands{ 0 };
+            std::atomic<uint64> Moves{ 0 };     // counted by the sessions
+
+            static void Increment(std::atomic<uint64>& counter, uint64 by = 1)
+            {
+                counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+            }
+        };
+
+        // Lets the process hold as many sockets as it is allowed to
+        inline void RaiseFileLimit()
+        {
+            struct rlimit limit;
+            if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+            {
+                limit.rlim_cur = limit.rlim_max;
+                ::setrlimit(RLIMIT_NOFILE, &limit);
+            }
+        }
+
+        // What the backends have in common: the listening socket, the
+        // connection table and its pool, and running complete lines through
+        // the sessions. How sockets are waited on and read is theirs.
+        class Server
+        {
+        public:
+            // A line longer than this ends the connection
+            static const size_t MAX_LINE = 1 << 12;
+            // A client this far behind on its replies is not read from until
+            // it catches up, which bounds the memory it can make us hold
+            static const size_t MAX_PENDING_OUTPUT = 1 << 20;
+            static const size_t READ_SIZE = 1 << 14;
+
+            explicit Server(const SessionFactory& factory) : listen_fd(-1), wake_fd(-1), factory(factory) {}
+
+            virtual ~Server()
+            {
+                for (auto& connection : connections)
+                {
+                    if (connection) { ::close(connection->Fd); }
+                }
+                if (listen_fd >= 0) { ::close(listen_fd); }
+                if (wake_fd >= 0) { ::close(wake_fd); }
+            }
+
+            Server(const Server&) = delete;
+            Server& operator =(const Server&) = delete;
+
+            // Binds address:port (port 0 for any free one) and starts
+            // listening; with reuse_port, other shards can bind it as well.
+            // False with errno set on failure.
+            bool Listen(const char* address, uint16 port, bool reuse_port = false)
+            {
+                wake_fd = ::eventfd(0, EFD_CLOEXEC);
+                if (wake_fd < 0) { return false; }
+                struct sockaddr_in addr;
+                std::memset(&addr, 0, sizeof addr);
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                if (::inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+                {
+                    errno = EINVAL;
+                    return false;
+                }
+
+                listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                if (listen_fd < 0) { return false; }
+                int on = 1;
+                ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+                if (reuse_port && ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on) < 0)
+                {
+                    return false;
+                }
+                if (::bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0 ||
+                    ::listen(listen_fd, SOMAXCONN) < 0)
+                {
+                    return false;
+                }
+                return StartListening();
+            }
+
+            // The port actually listened on
+            uint16 Port() const
+            {
+                struct sockaddr_in addr;
+                socklen_t size = sizeof addr;
+                if (::getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &size) < 0) { return 0; }
+                return ntohs(addr.sin_port);
+            }
+
+            ServerStats& Stats()
+            {
+                return stats;
+            }
+
+            // Which kind of loop this is, for the logs
+            virtual const char* Backend() const = 0;
+
+            // Serves connections until Stop
+            virtual void Run() = 0;
+
+            // Makes Run return, from any thread. Connections still open are
+            // closed with the server.
+            void Stop()
+            {
+                uint64 one = 1;
+                auto written = ::write(wake_fd, &one, sizeof one);
+                (void)written;
+            }
+
+        protected:
+            struct Connection
+            {
+                int Fd = -1;
+                std::unique_ptr<ServerSession> Session;
+                std::string In;         // received, from InBegin on not yet run
+                size_t InBegin = 0;
+                std::string Out;        // replies, from OutBegin on not yet sent
+                size_t OutBegin = 0;
+                bool Eof = false;       // the client has finished sending
+                bool Closing = false;   // the session is over
+            };
+
+            // Called once listen_fd listens, to start waiting on it
+            virtual bool StartListening() = 0;
+
+            // Takes on an accepted socket: its record, its session and the
+            // greeting in Out
+            Connection& Open(int fd)
+            {
+                int on = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+                if (size_t(fd) >= connections.size())
+                {
+                    connections.resize(size_t(fd) + 1);
+                }
+                auto connection = NewConnection();
+                connection->Fd = fd;
+                connection->Session = factory(connection->Out);
+                connections[fd] = std::move(connection);
+                ServerStats::Increment(stats.Accepted);
+                return *connections[fd];
+            }
+
+            // Runs the complete lines in In, for as long as the client keeps
+            // up with the replies
+            void RunLines(Connection& connection)
+            {
+                auto& in = connection.In;
+                while (!connection.Closing && connection.Out.size() - connection.OutBegin < MAX_PENDING_OUTPUT)
+                {
+                    auto begin = in.data() + connection.InBegin;
+                    auto newline = static_cast<const char*>(std::memchr(begin, '\n', in.size() - connection.InBegin));
+                    if (!newline)
+                    {
+                        if (in.size() - connection.InBegin > MAX_LINE) { connection.Closing = true; }
+                        break;
+                    }
+                    auto size = size_t(newline - begin);
+                    if (size && begin[size - 1] == '\r') { --size; }
+                    connection.InBegin = size_t(newline - in.data()) + 1;
+                    ServerStats::Increment(stats.Commands);
+                    if (!connection.Session->Execute(StringView(begin, size), connection.Out))
+                    {
+                        connection.Closing = true;
+                    }
+                }
+                if (connection.InBegin == in.size())
+                {
+                    in.clear();
+                    connection.InBegin = 0;
+                }
+                else if (connection.InBegin > in.size() / 2)
+                {
+                    in.erase(0, connection.InBegin);
+                    connection.InBegin = 0;
+                }
+            }
+
+            void Close(Connection& connection)
+            {
+                auto fd = connection.Fd;
+                ::close(fd);
+                FreeConnection(std::move(connections[fd]));
+                ServerStats::Increment(stats.Closed);
+            }
+
+            int listen_fd;
+            // readable once Stop has been called
+            int wake_fd;
+            // by descriptor, which the kernel keeps dense
+            std::vector<std::unique_ptr<Connection>> connections;
+
+        private:
+            // Connection records are recycled instead of freed, buffers and
+            // all, so accepting costs no allocation once the shard has seen
+            // as many connections at a time
+            std::unique_ptr<Connection> NewConnection()
+            {
+                if (free_connections.empty())
+                {
+                    return std::unique_ptr<Connection>(new Connection);
+                }
+                auto connection = std::move(free_connections.back());
+                free_connections.pop_back();
+                return connection;
+            }
+
+            void FreeConnection(std::unique_ptr<Connection> connection)
+            {
+                connection->Session.reset();
+                connection->In.clear();
+                connection->InBegin = 0;
+                connection->Out.clear();
+                connection->OutBegin = 0;
+                connection->Eof = false;
+                connection->Closing = false;
+                // whatever a flood of output grew them to goes back
+                if (connection->Out.capacity() > READ_SIZE) { connection->Out.shrink_to_fit(); }
+                if (connection->In.capacity() > READ_SIZE) { connection->In.shrink_to_fit(); }
+                free_connections.push_back(std::move(connection));
+            }
+
+            SessionFactory factory;
+            std::vector<std::unique_ptr<Connection>> free_connections;
+            ServerStats stats;
+        };
+
+        // Readiness-based loop: edge-triggered epoll, with every socket read
+        // and written by plain system calls until it would block
+        class EpollServer : public Server
+        {
+        public:
+            static const int MAX_EVENTS = 256;
+            // How often accepting is retried while it is paused, should no
+            // connection close in the meantime
+            static const int ACCEPT_RETRY_MS = 100;
+
+            explicit EpollServer(const SessionFactory& factory) : Server(factory), epoll_fd(-1), accept_paused(false) {}
+
+            ~EpollServer()
+            {
+                if (epoll_fd >= 0) { ::close(epoll_fd); }
+            }
+
+            virtual const char* Backend() const override
+            {
+                return "epoll";
+            }
+
+            virtual void Run() override
+            {
+                struct epoll_event events[MAX_EVENTS];
+                for (;;)
+                {
+                    auto count = ::epoll_wait(epoll_fd, events, MAX_EVENTS, accept_paused ? ACCEPT_RETRY_MS : -1);
+                    if (count < 0 && errno != EINTR) { return; }
+                    if (count == 0 && accept_paused) { ResumeAccepting(); }
+                    for (auto i = 0; i < count; ++i)
+                    {
+                        auto fd = events[i].data.fd;
+                        if (fd == wake_fd)
+                        {
+                            return;
+                        }
+                        if (fd == listen_fd)
+                        {
+                            Accept();
+                        }
+                        else if (size_t(fd) < connections.size() && connections[fd])
+                        {
+                            // read, write and hang-up events alike: Service
+                            // finds out what there is to do
+                            Service(*connections[fd]);
+                        }
+                    }
+                }
+            }
+
+        protected:
+            virtual bool StartListening() override
+            {
+                epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+                return epoll_fd >= 0 && Watch(listen_fd, EPOLLIN) && Watch(wake_fd, EPOLLIN);
+            }
+
+        private:
+            bool Watch(int fd, uint32_t events)
+            {
+                struct epoll_event event;
+                event.events = events;
+                event.data.fd = fd;
+                return ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+            }
+
+            // Takes every pending connection
+            void Accept()
+            {
+                for (;;)
+                {
+                    auto fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd < 0)
+                    {
+                        if (errno == EINTR || errno == ECONNABORTED) { continue; }
+                        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                        {
+                            PauseAccepting();
+                        }
+                        // EAGAIN: all taken
+                        return;
+                    }
+                    auto& connection = Open(fd);
+                    if (!Watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET))
+                    {
+                        Close(connection);
+                        continue;
+                    }
+                    Service(connection);
+                }
+            }
+
+            // The listening socket is level-triggered, so while a connection
+            // waits that cannot be accepted for want of descriptors or
+            // memory, epoll_wait would report it again at once. It is left
+            // unwatched until a connection closes, or for ACCEPT_RETRY_MS.
+            void PauseAccepting()
+            {
+                struct epoll_event event;
+                event.events = 0;
+                event.data.fd = listen_fd;
+                accept_paused = ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &event) == 0;
+            }
+
+            void ResumeAccepting()
+            {
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.fd = listen_fd;
+                accept_paused = ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &event) != 0;
+            }
+
+            // A closed connection frees a descriptor to accept with
+            void Close(Connection& connection)
+            {
+                Server::Close(connection);
+                if (accept_paused) { ResumeAccepting(); }
+            }
+
+            // Runs what has come in and sends what is due, for as long as
+            // the socket has data and the client keeps up with the replies
+            void Service(Connection& connection)
+            {
+                for (;;)
+                {
+                    RunLines(connection);
+                    if (connection.Closing || connection.Eof) { break; }
+                    if (connection.Out.size() - connection.OutBegin >= MAX_PENDING_OUTPUT)
+                    {
+                        // resumed by the write event once the client reads
+                        if (!Send(connection)) { return Close(connection); }
+                        if (connection.Out.size() - connection.OutBegin >= MAX_PENDING_OUTPUT) { return; }
+                        continue;
+                    }
+                    if (!Receive(connection)) { break; }
+                }
+                if (!Send(connection))
+                {
+                    return Close(connection);
+                }
+                if ((connection.Closing || connection.Eof) && connection.OutBegin == connection.Out.size())
+                {
+                    Close(connection);
+                }
+            }
+
+            // One read into In. False when nothing more is available now.
+            bool Receive(Connection& connection)
+            {
+                char buffer[READ_SIZE];
+                for (;;)
+                {
+                    auto count = ::recv(connection.Fd, buffer, sizeof buffer, 0);
+                    if (count > 0)
+                    {
+                        connection.In.append(buffer, size_t(count));
+                        return true;
+                    }
+                    if (count < 0 && errno == EINTR) { continue; }
+                    if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                    {
+                        // closed or reset: no more commands
+                        connection.Eof = true;
+                    }
+                    return false;
+                }
+            }
+
+            // Sends as much of Out as the socket takes. False on an error.
+            bool Send(Connection& connection)
+            {
+                auto& out = connection.Out;
+                while (connection.OutBegin < out.size())
+                {
+                    auto count = ::send(connection.Fd, out.data() + connection.OutBegin, out.size() - connection.OutBegin, MSG_NOSIGNAL);
+                    if (count > 0)
+                    {
+                        connection.OutBegin += size_t(count);
+                        continue;
+                    }
+                    if (count < 0 && errno == EINTR) { continue; }
+                    // EAGAIN: the write event brings us back
+                    return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+                }
+                out.clear();
+                connection.OutBegin = 0;
+                return true;
+            }
+
+            int epoll_fd;
+            bool accept_paused;
+        };
+    }
+}
+
+#endif /* __linux__ */
+
+#endif /* __nim_server_hpp__ */
@@ -0,0 +1,322 @@
+/*
+ * shm.hpp
+ *
+ * Shared-memory channel between the engine and a client on the same host:
+ * a file in /dev/shm holding two single-producer/single-consumer rings of
+ * fixed-size binary records, requests one way and replies the other. A
+ * round trip is a record copied into the mapping and an index stored on
+ * each side, with no system call while both sides are busy; a side that
+ * runs out of work spins for a moment and then sleeps on a futex in the
+ * mapping, which the other side wakes only when someone is asleep.
+ *
+ * Both the engine (nim --shm) and the reference client (nim_shm_client)
+ * are built from this header, so the layout only has to be right once.
+ */
+
+#ifndef __nim_shm_hpp__
+#define __nim_shm_hpp__
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <nim/nim_stdtypes.h>
+
+namespace nim
+{
+    namespace detail
+    {
+        const uint32 SHM_MAGIC = 0x524d494e;    // "NIMR"
+        const uint32 SHM_VERSION = 1;
+        // records per ring, a power of two
+        const uint32 SHM_RING_RECORDS = 64;
+        // the most piles a reply has room for, and so the most an shm game
+        // can have
+        const int32 SHM_MAX_PILES = 32;
+
+        enum ShmOp : uint32
+        {
+            SHM_SHOW,
+            SHM_MOVE,
+            SHM_RESTART,
+            SHM_ANALYZE,
+            SHM_CLOSE       // the client is done; the engine exits
+        };
+
+        enum ShmStatus : uint32
+        {
+            SHM_OK,
+            SHM_RANGE,      // no such pile, an empty one, or too many chips
+            SHM_OVER,       // a move after the game has ended
+            SHM_UNKNOWN_OP
+        };
+
+        // The opponent a SHM_RESTART asks for
+        enum ShmOpponent : int32
+        {
+            SHM_SAME,
+            SHM_CPU,
+            SHM_HUMAN
+        };
+
+        // Client to engine. SHM_MOVE takes Count chips from pile Pile
+        // (counting from 1). SHM_RESTART takes Pile as the ShmOpponent and
+        // Count as the new number of piles, 0 to keep it.
+        struct ShmRequest
+        {
+            uint32 Id;      // echoed in the reply
+            uint32 Op;
+            int32 Pile;
+            int32 Count;
+        };
+
+        // Engine to client, one per request: its status and the game after it
+        struct ShmReply
+        {
+            uint32 Id;
+            uint32 Status;
+            int32 PileCount;
+            uint8 Turn;         // 1 or 2
+            uint8 CPU;          // whether player 2 is the CPU
+            uint8 Over;
+            uint8 Winner;       // 1 or 2, once over
+            int32 CPUPile;      // the CPU's answer, 0 if it did not move
+            int32 CPUCount;
+            int32 NimSum;       // SHM_ANALYZE only: the nim-sum, and the move
+            int32 BestPile;     // the CPU would make for the player to move
+            int32 BestCount;
+            int32 Piles[SHM_MAX_PILES];
+        };
+
+        // Each index on a cache line of its own, so the two sides do not
+        // take turns owning one line for every record
+        template <typename Record>
+        struct ShmRing
+        {
+            alignas(64) uint32 Head;    // next record to read, moved by the consumer
+            uint32 HeadWaiters;         // producers asleep on a full ring
+            alignas(64) uint32 Tail;    // next record to write, moved by the producer
+            uint32 TailWaiters;         // consumers asleep on an empty ring
+            alignas(64) Record Records[SHM_RING_RECORDS];
+        };
+
+        struct ShmLayout
+        {
+            uint32 Magic;       // written last by the engine, once the rest is set up
+            uint32 Version;
+            uint32 RequestSize;
+            uint32 ReplySize;
+            int32 EnginePid;
+            int32 ClientPid;    // 0 until a client attaches
+            ShmRing<ShmRequest> Requests;
+            ShmRing<ShmReply> Replies;
+        };
+
+        class ShmChannel
+        {
+        public:
+            // Polls of the other side's index before going to sleep. Only
+            // worth it when the other side runs on another core meanwhile.
+            static const int SPIN_LIMIT = 1 << 12;
+            // How often a sleeper checks that the other side is still there
+            static const int LIVENESS_MS = 1000;
+
+            ShmChannel() : layout(nullptr), engine(false), spin_limit(std::thread::hardware_concurrency() > 1 ? SPIN_LIMIT : 0) {}
+
+            ~ShmChannel()
+            {
+                if (layout) { ::munmap(layout, sizeof(ShmLayout)); }
+                if (engine && !path.empty()) { ::unlink(path.c_str()); }
+            }
+
+            ShmChannel(const ShmChannel&) = delete;
+            ShmChannel& operator =(const ShmChannel&) = delete;
+
+            // The file for a channel name (no slashes)
+            static std::string PathOf(const std::string& name)
+            {
+                return "/dev/shm/" + name;
+            }
+
+            // Engine side: creates the channel, replacing a stale one of the
+            // same name. False with errno set on failure.
+            bool Create(const std::string& name)
+            {
+                path = PathOf(name);
+                ::unlink(path.c_str());
+                auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+                if (fd < 0) { return false; }
+                engine = true;
+                auto ok = ::ftruncate(fd, sizeof(ShmLayout)) == 0 && Map(fd);
+                ::close(fd);
+                if (!ok) { return false; }
+                // fresh from ftruncate, so all zeroes already
+                layout->Version = SHM_VERSION;
+                layout->RequestSize = sizeof(ShmRequest);
+                layout->ReplySize = sizeof(ShmReply);
+                layout->EnginePid = int32(::getpid());
+                __atomic_store_n(&layout->Magic, SHM_MAGIC, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            // Client side: attaches to the engine's channel. False with errno
+            // set on failure: EPROTO for a file that is not a channel of
+            // this version, EBUSY when another client holds it.
+            bool Open(const std::string& name)
+            {
+                path = PathOf(name);
+                auto fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+                if (fd < 0) { return false; }
+                struct stat info;
+                auto ok = ::fstat(fd, &info) == 0 && size_t(info.st_size) == sizeof(ShmLayout) && Map(fd);
+                ::close(fd);
+                if (!ok)
+                {
+                    errno = EPROTO;
+                    return false;
+                }
+                if (__atomic_load_n(&layout->Magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || layout->Version != SHM_VERSION ||
+                    layout->RequestSize != sizeof(ShmRequest) || layout->ReplySize != sizeof(ShmReply))
+                {
+                    errno = EPROTO;
+                    return false;
+                }
+                auto client = int32(0);
+                auto self = int32(::getpid());
+                if (!__atomic_compare_exchange_n(&layout->ClientPid, &client, self, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                {
+                    // a client that went away without a word leaves its pid
+                    if (Alive(client) || !__atomic_compare_exchange_n(&layout->ClientPid, &client, self, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                    {
+                        errno = EBUSY;
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Engine side. False once the client is gone.
+            bool Receive(ShmRequest& request)
+            {
+                return Pop(layout->Requests, request);
+            }
+
+            bool Send(const ShmReply& reply)
+            {
+                return Push(layout->Replies, reply);
+            }
+
+            // Client side. False once the engine is gone.
+            bool Send(const ShmRequest& request)
+            {
+                return Push(layout->Requests, request);
+            }
+
+            bool Receive(ShmReply& reply)
+            {
+                return Pop(layout->Replies, reply);
+            }
+
+        private:
+            bool Map(int fd)
+            {
+                auto p = ::mmap(nullptr, sizeof(ShmLayout), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+                if (p == MAP_FAILED) { return false; }
+                layout = static_cast<ShmLayout*>(p);
+                return true;
+            }
+
+            static bool Alive(int32 pid)
+            {
+                return pid > 0 && (::kill(pid_t(pid), 0) == 0 || errno == EPERM);
+            }
+
+            // The other side: before a client attaches, the engine waits for
+            // one however long it takes
+            bool PeerAlive() const
+            {
+                if (!engine) { return Alive(layout->EnginePid); }
+                auto client = __atomic_load_n(&layout->ClientPid, __ATOMIC_ACQUIRE);
+                return client == 0 || Alive(client);
+            }
+
+            template <typename Record>
+            bool Push(ShmRing<Record>& ring, const Record& record)
+            {
+                auto tail = ring.Tail;
+                auto head = __atomic_load_n(&ring.Head, __ATOMIC_ACQUIRE);
+                if (tail - head == SHM_RING_RECORDS && !WaitWhile(&ring.Head, &ring.HeadWaiters, head)) { return false; }
+                ring.Records[tail % SHM_RING_RECORDS] = record;
+                Publish(&ring.Tail, &ring.TailWaiters, tail + 1);
+                return true;
+            }
+
+            template <typename Record>
+            bool Pop(ShmRing<Record>& ring, Record& record)
+            {
+                auto head = ring.Head;
+                if (__atomic_load_n(&ring.Tail, __ATOMIC_ACQUIRE) == head && !WaitWhile(&ring.Tail, &ring.TailWaiters, head)) { return false; }
+                record = ring.Records[head % SHM_RING_RECORDS];
+                Publish(&ring.Head, &ring.HeadWaiters, head + 1);
+                return true;
+            }
+
+            // Waits for *index to move off value: spinning first, then asleep
+            // on it. waiters is raised before *index is checked again and
+            // read after the other side moves it (both sequentially
+            // consistent), so a wake-up cannot be missed. False if the other
+            // side has gone away.
+            bool WaitWhile(uint32* index, uint32* waiters, uint32 value)
+            {
+                for (auto i = 0; i < spin_limit; ++i)
+                {
+                    if (__atomic_load_n(index, __ATOMIC_ACQUIRE) != value) { return true; }
+#if defined(__x86_64__) || defined(__i386__)
+                    __builtin_ia32_pause();
+#endif
+                }
+                for (;;)
+                {
+                    __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+                    if (__atomic_load_n(index, __ATOMIC_SEQ_CST) == value)
+                    {
+                        struct timespec timeout = { LIVENESS_MS / 1000, (LIVENESS_MS % 1000) * 1000000L };
+                        ::syscall(SYS_futex, index, FUTEX_WAIT, value, &timeout, nullptr, 0);
+                    }
+                    __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
+                    if (__atomic_load_n(index, __ATOMIC_ACQUIRE) != value) { return true; }
+                    if (!PeerAlive()) { return false; }
+                }
+            }
+
+            static void Publish(uint32* index, uint32* waiters, uint32 value)
+            {
+                __atomic_store_n(index, value, __ATOMIC_SEQ_CST);
+                if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) != 0)
+                {
+                    ::syscall(SYS_futex, index, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+                }
+            }
+
+            ShmLayout* layout;
+            bool engine;
+            int spin_limit;
+            std::string path;
+        };
+    }
+}
+
+#endif /* __linux__ */
+
+#endif /* __nim_shm_hpp__ */
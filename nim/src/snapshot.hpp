@@ -0,0 +1,211 @@
+/*
+ * snapshot.hpp
+ *
+ * Pieces of the binary session snapshots: LEB128 varints, so a pile of a
+ * few dozen chips takes one byte, a bounds-checked reader for them, and a
+ * table of interned player names, so the names every session shares
+ * ("player1", "cpu", ...) take one byte too instead of being spelled out
+ * in each snapshot. A version 1 snapshot is
+ *
+ *   'N' 'S'             magic
+ *   varint              version
+ *   byte                flags: 1 player 1 to move, 2 player 2 is the CPU
+ *   3 names             player 1, player 2 and the CPU, see PutName
+ *   varint              pile count, then each pile as a varint
+ *
+ * and nothing after it.
+ */
+
+#ifndef __nim_snapshot_hpp__
+#define __nim_snapshot_hpp__
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nim/nim_stdtypes.h>
+#include "command.hpp"
+
+namespace nim
+{
+    namespace detail
+    {
+        const char SNAPSHOT_MAGIC[2] = { 'N', 'S' };
+        const uint32 SNAPSHOT_VERSION = 1;
+
+        // Outcome of restoring a snapshot
+        enum class RestoreResult
+        {
+            Ok,
+            Malformed,      // not a snapshot, or a truncated or corrupt one
+            Version,        // a snapshot of a version this build cannot read
+            UnknownName,    // a name id missing from the table it is read with
+            Finished        // a game with no chips left
+        };
+
+        // Appends value 7 bits at a time, low bits first; every byte but the
+        // last has its top bit set
+        inline void PutVarint(std::string& out, uint64 value)
+        {
+            char bytes[10];
+            size_t size = 0;
+            while (value >= 0x80)
+            {
+                bytes[size++] = char(value | 0x80);
+                value >>= 7;
+            }
+            bytes[size++] = char(value);
+            out.append(bytes, size);
+        }
+
+        // Names by small ids and back. The default names have the first ids
+        // in every table, so a snapshot that uses nothing else can be read
+        // without the table it was written with.
+        class NameTable
+        {
+        public:
+            NameTable()
+            {
+                Intern("player1");
+                Intern("player2");
+                Intern("cpu");
+            }
+
+            // The id of name, interning it first if it is new
+            uint32 Intern(const std::string& name)
+            {
+                auto inserted = ids.insert(std::make_pair(name, uint32(names.size())));
+                if (inserted.second)
+                {
+                    // map nodes stay put, so their keys can be pointed at
+                    names.push_back(&inserted.first->first);
+                }
+                return inserted.first->second;
+            }
+
+            // The id of name, if it has been interned
+            bool Find(const std::string& name, uint32& id) const
+            {
+                auto found = ids.find(name);
+                if (found == ids.end()) { return false; }
+                id = found->second;
+                return true;
+            }
+
+            // The name of id, null if there is no such id
+            const std::string* Name(uint64 id) const
+            {
+                return id < names.size() ? names[size_t(id)] : nullptr;
+            }
+
+            size_t Size() const
+            {
+                return names.size();
+            }
+
+        private:
+            std::unordered_map<std::string, uint32> ids;
+            std::vector<const std::string*> names;
+        };
+
+        // The table a snapshot is read with when it was written without one
+        inline const NameTable& DefaultNames()
+        {
+            static const NameTable names;
+            return names;
+        }
+
+        // Appends name as a varint tag: an interned id n as 2n + 1, or a name
+        // spelled out as its length n as 2n, followed by its bytes. With a
+        // table, a new name is interned into it; without one, only the
+        // default names are written as ids.
+        inline void PutName(std::string& out, const std::string& name, NameTable* names)
+        {
+            uint32 id;
+            if (names)
+            {
+                PutVarint(out, uint64(names->Intern(name)) << 1 | 1);
+            }
+            else if (DefaultNames().Find(name, id))
+            {
+                PutVarint(out, uint64(id) << 1 | 1);
+            }
+            else
+            {
+                PutVarint(out, uint64(name.size()) << 1);
+                out += name;
+            }
+        }
+
+        // Reads back what PutVarint and friends wrote. Every read checks the
+        // end, so a truncated or corrupt snapshot fails instead of reading
+        // past it.
+        class SnapshotReader
+        {
+        public:
+            SnapshotReader(const char* data, size_t size) : p(data), end(data + size) {}
+
+            bool Varint(uint64& value)
+            {
+                value = 0;
+                for (auto shift = 0; shift < 64; shift += 7)
+                {
+                    if (p == end) { return false; }
+                    auto byte = uint8(*p++);
+                    // the tenth byte has room for the top bit only
+                    if (shift == 63 && byte > 1) { return false; }
+                    value |= uint64(byte & 0x7F) << shift;
+                    if (!(byte & 0x80)) { return true; }
+                }
+                return false;
+            }
+
+            bool Byte(uint8& value)
+            {
+                if (p == end) { return false; }
+                value = uint8(*p++);
+                return true;
+            }
+
+            // The next size bytes, as a view into the snapshot
+            bool Bytes(size_t size, StringView& bytes)
+            {
+                if (Remaining() < size) { return false; }
+                bytes = StringView(p, size);
+                p += size;
+                return true;
+            }
+
+            // A name written by PutName: a view into the snapshot, or into
+            // names for an interned one
+            RestoreResult Name(const NameTable& names, StringView& name)
+            {
+                uint64 tag;
+                if (!Varint(tag)) { return RestoreResult::Malformed; }
+                if (tag & 1)
+                {
+                    auto interned = names.Name(tag >> 1);
+                    if (!interned) { return RestoreResult::UnknownName; }
+                    name = StringView(interned->data(), interned->size());
+                    return RestoreResult::Ok;
+                }
+                return Bytes(size_t(tag >> 1), name) ? RestoreResult::Ok : RestoreResult::Malformed;
+            }
+
+            size_t Remaining() const
+            {
+                return size_t(end - p);
+            }
+
+            bool AtEnd() const
+            {
+                return p == end;
+            }
+
+        private:
+            const char* p;
+            const char* end;
+        };
+    }
+}
+
+#endif /* __nim_snapshot_hpp__ */
@@ -1,4 +1,10 @@
 #include "tinycon.h"
+#include <errno.h>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#endif
 
 /*
  * Terminal Console
@@ -25,38 +31,573 @@
 #	pragma GCC diagnostic ignored "-Wsign-compare"
 #endif
 
-// On Unix-like systems, add getch support without curses
+// How long to wait for the rest of an escape sequence before taking a lone
+// ESC for the Escape key, in milliseconds
+#define ESC_TIMEOUT 50
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+tinyTerminal::tinyTerminal ()
+{
+}
+
+tinyTerminal::~tinyTerminal ()
+{
+}
+
+// The console queues input events itself; this only drops the ones that are
+// not key presses (focus, mouse, key releases), which would otherwise keep
+// the input handle signaled with no key for _getch
+bool tinyTerminal::readInput ()
+{
+	HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+	INPUT_RECORD record;
+	DWORD count;
+	while (PeekConsoleInput(input, &record, 1, &count) && count)
+	{
+		if (record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown) break;
+		ReadConsoleInput(input, &record, 1, &count);
+	}
+	return true;
+}
+
+int tinyTerminal::nextKey ()
+{
+	while (_kbhit())
+	{
+		int ch = _getch();
+		if (ch == ESC) return TK_ESCAPE;
+		if (ch != 0 && ch != 0xE0) return ch;
+		// extended key: a scan code follows
+		switch (_getch())
+		{
+			case UP_ARROW: return TK_UP;
+			case DOWN_ARROW: return TK_DOWN;
+			case LEFT_ARROW: return TK_LEFT;
+			case RIGHT_ARROW: return TK_RIGHT;
+			case 71: return TK_HOME;
+			case 79: return TK_END;
+			case 83: return TK_DELETE;
+		}
+	}
+	return TK_NONE;
+}
+
+bool tinyTerminal::partial () const
+{
+	return false;
+}
+
+int tinyTerminal::expire ()
+{
+	return TK_NONE;
+}
+
+int tinyTerminal::readKey ()
+{
+	for (;;)
+	{
+		std::cout.flush();
+		// _kbhit does not block; _getch does, so wait in there
+		int ch = _getch();
+		if (ch == ESC) return TK_ESCAPE;
+		if (ch != 0 && ch != 0xE0) return ch;
+		switch (_getch())
+		{
+			case UP_ARROW: return TK_UP;
+			case DOWN_ARROW: return TK_DOWN;
+			case LEFT_ARROW: return TK_LEFT;
+			case RIGHT_ARROW: return TK_RIGHT;
+			case 71: return TK_HOME;
+			case 79: return TK_END;
+			case 83: return TK_DELETE;
+		}
+	}
+}
+#else
+enum { GROUND, ESCAPE, CSI, SS3 };
+
+tinyTerminal::tinyTerminal () : raw(false), eof(false), head(0), tail(0), state(GROUND), param(0), first_param(true)
+{
+	if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved) == 0)
+	{
+		struct termios newt = saved;
+		newt.c_lflag &= ~(ICANON | ECHO);
+		newt.c_cc[VMIN] = 1;
+		newt.c_cc[VTIME] = 0;
+		raw = tcsetattr(STDIN_FILENO, TCSANOW, &newt) == 0;
+	}
+}
+
+tinyTerminal::~tinyTerminal ()
+{
+	if (raw) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+}
+
+// Whether input arrives within timeout ms (forever if negative)
+bool tinyTerminal::wait (int timeout)
+{
+	struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+	int ready;
+	while ((ready = poll(&pfd, 1, timeout)) < 0 && errno == EINTR) {}
+	return ready > 0;
+}
+
+// One read() of whatever is available into the free space behind tail.
+// Blocks if nothing is, so an event loop calls it only once stdin polls
+// readable. False at the end of input.
+bool tinyTerminal::readInput ()
+{
+	// one byte of slack keeps the byte before head for nextKey to step
+	// back onto
+	size_t used = tail - head;
+	if (used >= RING_SIZE - 1) return true;
+	size_t at = tail % RING_SIZE;
+	size_t room = RING_SIZE - at;
+	if (room > RING_SIZE - 1 - used) room = RING_SIZE - 1 - used;
+	for (;;)
+	{
+		ssize_t count = read(STDIN_FILENO, ring + at, room);
+		if (count > 0)
+		{
+			tail += count;
+			return true;
+		}
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+		eof = true;
+		return false;
+	}
+}
+
+// Key for the final byte of an ESC [ or ESC O sequence and its first
+// numeric parameter, 0 for sequences we do not handle
+static int sequenceKey (int final, int param)
+{
+	switch (final)
+	{
+		case UP_ARROW: return TK_UP;
+		case DOWN_ARROW: return TK_DOWN;
+		case LEFT_ARROW: return TK_LEFT;
+		case RIGHT_ARROW: return TK_RIGHT;
+		case 'H': return TK_HOME;
+		case 'F': return TK_END;
+		case '~':
+			switch (param)
+			{
+				case 1: case 7: return TK_HOME;
+				case 4: case 8: return TK_END;
+				case DEL - '0': return TK_DELETE;
+			}
+	}
+	return 0;
+}
+
+// Next key from the buffered input: TK_NONE when it runs out (possibly in
+// the middle of a sequence, which is kept for the next call), TK_EOF once
+// the input has ended
+int tinyTerminal::nextKey ()
+{
+	while (head != tail)
+	{
+		int ch = ring[head++ % RING_SIZE];
+		switch (state)
+		{
+			case GROUND:
+				if (ch == ESC)
+				{
+					state = ESCAPE;
+					break;
+				}
+				return ch == '\b' ? BACKSPACE : ch;
+			case ESCAPE:
+				if (ch == '[')
+				{
+					state = CSI;
+					param = 0;
+					first_param = true;
+					break;
+				}
+				if (ch == 'O')
+				{
+					state = SS3;
+					break;
+				}
+				// Escape followed by an ordinary key: hand that key out next
+				head--;
+				state = GROUND;
+				return TK_ESCAPE;
+			case CSI:
+				if (ch >= '0' && ch <= '9')
+				{
+					if (first_param && param < 1000) param = param * 10 + (ch - '0');
+					break;
+				}
+				if (ch == ';') first_param = false;
+				// other parameter and intermediate bytes
+				if (ch >= 0x20 && ch <= 0x3F) break;
+				state = GROUND;
+				if (int key = sequenceKey(ch, param)) return key;
+				break;
+			case SS3:
+				state = GROUND;
+				if (int key = sequenceKey(ch, 0)) return key;
+				break;
+		}
+	}
+	if (!eof) return TK_NONE;
+	int key = expire();
+	return key != TK_NONE ? key : TK_EOF;
+}
+
+// In the middle of an escape sequence
+bool tinyTerminal::partial () const
+{
+	return state != GROUND;
+}
+
+// Gives up on the sequence in progress: a lone ESC is the Escape key, a
+// sequence cut short is dropped
+int tinyTerminal::expire ()
+{
+	int key = state == ESCAPE ? TK_ESCAPE : TK_NONE;
+	state = GROUND;
+	return key;
+}
+
+int tinyTerminal::readKey ()
+{
+	for (;;)
+	{
+		int key = nextKey();
+		if (key != TK_NONE) return key;
+		if (partial())
+		{
+			// the rest of a sequence is normally already on its way; only a
+			// lone ESC makes us wait out the timeout
+			if (!wait(ESC_TIMEOUT) && (key = expire()) != TK_NONE) return key;
+			if (partial()) readInput();
+		}
+		else
+		{
+			// about to block: whatever was echoed must be on screen first
+			std::cout.flush();
+			readInput();
+		}
+	}
+}
+#endif
+
+tinyEventLoop::tinyEventLoop () : next_timer(0), stopped(false), owner(std::this_thread::get_id()), wake_pending(false)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+	wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+	// opened by the first run, so a console that is never run (one per
+	// network session, say) holds no descriptors
+	wake_pipe[0] = wake_pipe[1] = -1;
+#endif
+}
+
+tinyEventLoop::~tinyEventLoop ()
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+	CloseHandle(wake_event);
+#else
+	if (wake_pipe[0] >= 0)
+	{
+		close(wake_pipe[0]);
+		close(wake_pipe[1]);
+	}
+#endif
+}
+
+// Calls on_readable from the loop whenever fd has input (or hit its end)
+void tinyEventLoop::watch (int fd, const Task& on_readable)
+{
+	unwatch(fd);
+	Watch w = { fd, on_readable };
+	watches.push_back(w);
+}
+
+void tinyEventLoop::unwatch (int fd)
+{
+	for (size_t i = 0; i < watches.size(); i++)
+	{
+		if (watches[i].fd == fd)
+		{
+			watches.erase(watches.begin() + i);
+			return;
+		}
+	}
+}
+
+// Calls on_expiry from the loop in ms milliseconds. The returned id can
+// cancel it until then.
+int tinyEventLoop::addTimer (int ms, const Task& on_expiry)
+{
+	int id = ++next_timer;
+	timers[std::make_pair(clock::now() + std::chrono::milliseconds(ms), id)] = on_expiry;
+	return id;
+}
+
+void tinyEventLoop::cancelTimer (int id)
+{
+	for (std::map<std::pair<clock::time_point, int>, Task>::iterator i = timers.begin(); i != timers.end(); ++i)
+	{
+		if (i->first.second == id)
+		{
+			timers.erase(i);
+			return;
+		}
+	}
+}
+
+// Runs task on the loop's thread, after what is already queued. Safe to
+// call from any thread.
+void tinyEventLoop::post (const Task& task)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	tasks.push_back(task);
+	// the loop checks its tasks before it waits again, so only another
+	// thread has to wake it
+	if (wake_pending || std::this_thread::get_id() == owner) return;
+	wake_pending = true;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+	SetEvent(wake_event);
+#else
+	if (wake_pipe[1] >= 0)
+	{
+		ssize_t written = write(wake_pipe[1], "", 1);
+		(void) written;
+	}
+#endif
+}
+
+// Makes run return once the callback in progress does
+void tinyEventLoop::stop ()
+{
+	stopped = true;
+}
+
+void tinyEventLoop::run ()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		owner = std::this_thread::get_id();
 #if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32)
-int getch ()
-{
-	struct termios oldt, newt;
-	int ch;
-	tcgetattr(STDIN_FILENO, &oldt);
-	newt = oldt;
-	newt.c_lflag &= ~(ICANON | ECHO);
-	tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-	
-	ch = getchar();	
-	if(ch == ESC)
+		if (wake_pipe[0] < 0 && pipe(wake_pipe) == 0)
+		{
+			// a full pipe means a wake-up is pending anyway
+			fcntl(wake_pipe[0], F_SETFL, fcntl(wake_pipe[0], F_GETFL) | O_NONBLOCK);
+			fcntl(wake_pipe[1], F_SETFL, fcntl(wake_pipe[1], F_GETFL) | O_NONBLOCK);
+		}
+#endif
+	}
+	stopped = false;
+	while (runTasks() && runTimers())
 	{
-		ch = getchar();
-		if(ch == 91)
+		wait(timeout());
+	}
+}
+
+// Runs the tasks queued so far; false if one of them stopped the loop, in
+// which case the rest stay queued for the next run
+bool tinyEventLoop::runTasks ()
+{
+	std::vector<Task> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.swap(tasks);
+	}
+	for (size_t i = 0; i < ready.size(); i++)
+	{
+		ready[i]();
+		if (stopped)
 		{
-			ch = KEY_CTRL1;
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.insert(tasks.begin(), ready.begin() + i + 1, ready.end());
+			return false;
 		}
 	}
-	tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-	return ch;
+	return true;
+}
+
+// Fires the timers that are due; false if one of them stopped the loop
+bool tinyEventLoop::runTimers ()
+{
+	clock::time_point now = clock::now();
+	while (!timers.empty() && timers.begin()->first.first <= now)
+	{
+		Task on_expiry = timers.begin()->second;
+		timers.erase(timers.begin());
+		on_expiry();
+		if (stopped) return false;
+	}
+	return true;
 }
+
+// How long the loop may sleep: not at all with tasks queued, until the
+// next timer with one set, otherwise until something happens
+int tinyEventLoop::timeout ()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!tasks.empty()) return 0;
+	}
+	if (timers.empty()) return -1;
+	clock::duration left = timers.begin()->first.first - clock::now();
+	if (left <= clock::duration::zero()) return 0;
+	// round up, so the timer is due when we wake
+	return int(std::chrono::duration_cast<std::chrono::milliseconds>(left + std::chrono::milliseconds(1) - clock::duration(1)).count());
+}
+
+// Waits up to timeout ms for a watched fd or a wake-up, then calls the
+// handlers of the fds that are ready
+void tinyEventLoop::wait (int timeout)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+	std::vector<HANDLE> handles(1, wake_event);
+	for (size_t i = 0; i < watches.size(); i++)
+	{
+		handles.push_back((HANDLE) _get_osfhandle(watches[i].fd));
+	}
+	DWORD ready = WaitForMultipleObjects((DWORD) handles.size(), &handles[0], FALSE, timeout < 0 ? INFINITE : (DWORD) timeout);
+	if (ready == WAIT_OBJECT_0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake_pending = false;
+	}
+	else if (ready > WAIT_OBJECT_0 && ready < WAIT_OBJECT_0 + handles.size())
+	{
+		// copied, the handler may unwatch itself
+		Task on_readable = watches[ready - WAIT_OBJECT_0 - 1].on_readable;
+		on_readable();
+	}
+#else
+	std::vector<struct pollfd> fds(1);
+	fds[0].fd = wake_pipe[0];
+	fds[0].events = POLLIN;
+	for (size_t i = 0; i < watches.size(); i++)
+	{
+		struct pollfd pfd = { watches[i].fd, POLLIN, 0 };
+		fds.push_back(pfd);
+	}
+	if (poll(&fds[0], fds.size(), timeout) <= 0) return;
+
+	if (fds[0].revents)
+	{
+		char drain[64];
+		while (read(wake_pipe[0], drain, sizeof drain) > 0) {}
+		std::lock_guard<std::mutex> lock(mutex);
+		wake_pending = false;
+	}
+	for (size_t i = 1; i < fds.size() && !stopped; i++)
+	{
+		if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+		// looked up again, an earlier handler may have changed the watches
+		for (size_t j = 0; j < watches.size(); j++)
+		{
+			if (watches[j].fd == fds[i].fd)
+			{
+				Task on_readable = watches[j].on_readable;
+				on_readable();
+				break;
+			}
+		}
+	}
 #endif
+}
+
+// Room the gap gets whenever it runs out
+#define GAP_SIZE 64
+
+tinyLineBuffer::tinyLineBuffer () : data(GAP_SIZE), gap_begin(0), gap_end(GAP_SIZE)
+{
+}
+
+void tinyLineBuffer::moveTo (size_t pos)
+{
+	if (pos > size()) pos = size();
+	if (pos < gap_begin)
+	{
+		// characters between pos and the cursor go behind the gap
+		size_t count = gap_begin - pos;
+		memmove(data.data() + gap_end - count, data.data() + pos, count);
+		gap_begin -= count;
+		gap_end -= count;
+	}
+	else if (pos > gap_begin)
+	{
+		size_t count = pos - gap_begin;
+		memmove(data.data() + gap_begin, data.data() + gap_end, count);
+		gap_begin += count;
+		gap_end += count;
+	}
+}
+
+void tinyLineBuffer::insert (char c)
+{
+	if (gap_begin == gap_end)
+	{
+		// widen the gap, moving the text after it to the new end
+		size_t tail = data.size() - gap_end;
+		size_t grow = data.size() < GAP_SIZE ? GAP_SIZE : data.size();
+		data.resize(data.size() + grow);
+		memmove(data.data() + gap_end + grow, data.data() + gap_end, tail);
+		gap_end += grow;
+	}
+	data[gap_begin++] = c;
+}
+
+// Deletes the character before the cursor
+bool tinyLineBuffer::erase ()
+{
+	if (gap_begin == 0) return false;
+	gap_begin--;
+	return true;
+}
+
+// Deletes the character under the cursor
+bool tinyLineBuffer::eraseForward ()
+{
+	if (gap_end == data.size()) return false;
+	gap_end++;
+	return true;
+}
+
+void tinyLineBuffer::assign (const std::string& line)
+{
+	clear();
+	if (data.size() < line.size() + GAP_SIZE) data.resize(line.size() + GAP_SIZE);
+	memcpy(data.data(), line.data(), line.size());
+	gap_begin = line.size();
+	gap_end = data.size();
+}
+
+void tinyLineBuffer::clear ()
+{
+	gap_begin = 0;
+	gap_end = data.size();
+}
+
+std::string tinyLineBuffer::str () const
+{
+	std::string line(data.begin(), data.begin() + gap_begin);
+	appendTail(line);
+	return line;
+}
+
+// Appends the text from the cursor to the end of the line
+void tinyLineBuffer::appendTail (std::string& out) const
+{
+	out.append(data.begin() + gap_end, data.end());
+}
 
 tinyConsole::tinyConsole ()
 {
 	_max_history = MAX_HISTORY;
 	_quit = false;
 	pos = -1;
-	line_pos = 0;
-	skip_out = 0;
 }
 
 tinyConsole::tinyConsole (std::string s)
@@ -65,8 +606,6 @@ tinyConsole::tinyConsole (std::string s)
 	_quit = false;
 	_prompt = s;
 	pos = -1;
-	line_pos = 0;
-	skip_out = 0;
 }
 
 std::string tinyConsole::version ()
@@ -76,7 +615,8 @@ std::string tinyConsole::version ()
 
 void tinyConsole::pause ()
 {
-	getch();
+	tinyTerminal terminal;
+	terminal.readKey();
 }
 
 void tinyConsole::quit ()
@@ -84,7 +624,7 @@ void tinyConsole::quit ()
 	_quit = true;
 }
 
-int tinyConsole::trigger (std::string cmd)
+int tinyConsole::trigger (const std::string& cmd)
 {
 	if (cmd == "exit") {
 		_quit = true;
@@ -94,7 +634,7 @@ int tinyConsole::trigger (std::string cmd)
 	return 0;
 }
 
-void tinyConsole::setPrompt(std::string p)
+void tinyConsole::setPrompt(const std::string& p)
 {
     _prompt = p;
 }
@@ -121,17 +661,20 @@ std::string tinyConsole::getLine (int mode)
 
 std::string tinyConsole::getLine (int mode = M_LINE, std::string delimeter = "")
 {
+	tinyTerminal terminal;
 	std::string line;
-	char c;
+	int c;
 
 	for (;;)
 	{
-		c = getch();
-		if ( c == NEWLINE)
+		c = terminal.readKey();
+		if (c == NEWLINE || c == TK_EOF)
 		{
 			std::cout << std::endl;
 			return line;
-		} else if ((int) c == BACKSPACE ) {
+		} else if (c >= TK_ESCAPE) {
+			// no editing keys here
+		} else if (c == BACKSPACE) {
 			if (line.length())
 			{
 				line = line.substr(0,line.size()-1);
@@ -141,10 +684,10 @@ std::string tinyConsole::getLine (int mode = M_LINE, std::string delimeter = "")
 				}
 			}
 		} else {
-			line += c;
+			line += char(c);
 			if (mode != M_PASSWORD)
 			{
-				std::cout << c;
+				std::cout << char(c);
 			}
 		}
 	}
@@ -152,226 +695,231 @@ std::string tinyConsole::getLine (int mode = M_LINE, std::string delimeter = "")
 
 void tinyConsole::setBuffer (std::string s)
 {
-	buffer.assign(s.begin(),s.end());
-	line_pos = buffer.size();
+	buffer.assign(s);
+}
+
+// ANSI sequence moving the cursor count columns to the left
+static void cursorLeft (std::string& out, size_t count)
+{
+	if (count == 0) return;
+	char seq[24];
+	snprintf(seq, sizeof seq, "\x1b[%uD", (unsigned) count);
+	out += seq;
+}
+
+// Replaces the edit line on screen and in the buffer
+void tinyConsole::replaceLine (const std::string& line)
+{
+	cursorLeft(edit, buffer.cursor());
+	// clear to the end of the line
+	edit += "\x1b[K";
+	edit += line;
+	buffer.assign(line);
 }
 
 void tinyConsole::run ()
 {
+	// raw mode for the whole session, restored on every way out
+	tinyTerminal terminal;
+
 	//show prompt
 	std::cout << _prompt;
 
     _quit = false;
+	dispatching = false;
+	escape_timer = 0;
+
+	// keys are handled as they come in; commands are run by the loop
+	loop.watch(fileno(stdin), [this, &terminal] {
+		if (!dispatching) terminal.readInput();
+		readKeys(terminal);
+	});
+	std::cout.flush();
+	loop.run();
+	loop.unwatch(fileno(stdin));
+	if (escape_timer) loop.cancelTimer(escape_timer);
+	escape_timer = 0;
+}
+
+// The loop run() runs on: timers and worker completions of the program
+// driving the console go here as well
+tinyEventLoop& tinyConsole::eventLoop ()
+{
+	return loop;
+}
 
-	// grab input
+// Handles the keys that have come in, up to the end of a command line,
+// which is left to the loop to dispatch. What they change on screen goes
+// out at once.
+void tinyConsole::readKeys (tinyTerminal& terminal)
+{
+	if (dispatching) return;
+	edit.clear();
 	for (;;)
 	{
-		c = getch();
-		if(!hotkeys(c))
-		switch (c)
+		int key = terminal.nextKey();
+		if (key == TK_NONE) break;
+		if (key == TK_EOF)
 		{
-			case ESC:
-				// TODO escape is only detected if double-pressed. this should be fixed
-				std::cout << "(Esc)";
-				break;
-			case KEY_CTRL1: // look for arrow keys
-				switch (c = getch())
-				{
-					case UP_ARROW:
-						if (!history.size()) break;
-						if (pos == -1)
-						{
-							// store current command
-							unused = "";
-							unused.assign(buffer.begin(), buffer.end());
-						}
-
-						// clear line
-						for (int i = 0; i < line_pos; i++)
-						{
-							std::cout << "\b \b";
-						}
-
-						// clean buffer
-						buffer.erase(buffer.begin(), buffer.end());
-
-						pos++;
-						if (pos > (history.size() - 1)) pos = history.size() - 1;
-
-						// store in buffer
-						for (int i = 0; i < history[pos].size(); i++)
-						{
-							buffer.push_back(history[pos][i]);
-						}
-						line_pos = buffer.size();
-						// output to screen
-						std::cout << history[pos];
-						break;
-					case DOWN_ARROW:
-						if (!history.size()) break;
-
-						// clear line
-						for (int i = 0; i < line_pos; i++)
-						{
-							std::cout << "\b \b";
-						}
-
-						// clean buffer
-						buffer.erase(buffer.begin(), buffer.end());
-
-						pos--;
-						if (pos<-1) pos = -1;
-						if (pos >= 0) {
-							std::cout << history[pos];
-							// store in buffer
-							for (int i = 0; i < history[pos].size(); i++)
-							{
-								buffer.push_back(history[pos][i]);
-							}
-						} else {
-							if (buffer.size())
-							{
-								std::cout << unused;
-								// store in buffer
-								for (int i = 0; i < unused.size(); i++)
-								{
-									buffer.push_back(unused[i]);
-								}
-							}
-						}
-						line_pos = buffer.size();
-						break;
-					case LEFT_ARROW:
-						// if there are characters to move left over, do so
-						if (line_pos)
-						{
-							std::cout << "\b";
-							line_pos--;
-						}
-						break;
-					case RIGHT_ARROW:
-						// if there are characters to move right over, do so
-						if (line_pos < buffer.size())
-						{
-							std::cout << buffer[line_pos];
-							line_pos++;
-						}
-						break;
-					case DEL:
-						if (line_pos < buffer.size())
-						{
-							skip_out = 1;
-							buffer.erase(buffer.begin()+line_pos);
-							// update screen after current position
-							for (int i = line_pos; i < buffer.size(); i++ )
-							{
-								std::cout << buffer[i];
-							}
-							// erase last char
-							std::cout << " ";
-							for (int i = line_pos; i < buffer.size(); i++ )
-							{
-								std::cout << "\b";
-							}
-							// make-up for erase position
-							std::cout << "\b";
-							//std::cout << "(DEL)";
-						}
-						break;
-					default:
-						skip_out = 1;
-						//std::cout << "(" << (int) c << ")" << std::endl;
-					}
-				break;
-			case BACKSPACE:
-				if (line_pos == 0) break;
-				// move cursor back, blank char, and move cursor back again
-				std::cout << "\b \b";
-				// don't forget to clean the buffer and update line position
-				if (line_pos == buffer.size()) {
-					buffer.pop_back();
-					line_pos--;
-				} else {
-					line_pos--;
-					buffer.erase(buffer.begin()+line_pos);
-					// update screen after current position
-					for (int i = line_pos; i < buffer.size(); i++ ) {
-						std::cout << buffer[i];
-					}
-					// erase last char
-					std::cout << " ";
-					for (int i = line_pos+1; i < buffer.size(); i++ ) {
-						std::cout << "\b";
-					}
-					// make-up for erase position and go to new position
-					std::cout << "\b\b";
-				}
-				break;
-			case TAB:
-				break;
-				// print history
-				for (int i = 0; i < history.size(); i++) {
-					std::cout << history[i] << std::endl;
-				}
-				break;
-			case NEWLINE:
-				// store in string
-				s.assign(buffer.begin(), buffer.end());
-
-				
-				
-				// save command to history
-				// trimming of command should be done in callback function
-				if(s.length()) 
-					history.push_front(s);
-
-				// run command
-				//(*callbackFunc)(s.c_str());
-				std::cout << std::endl;
-				trigger(s);
-				
-				// check for exit command
-				if(_quit == true) {
-					return;
-				}
-				
-				if (history.size() > _max_history) history.pop_back();
-
-				// clean buffer
-				buffer.erase(buffer.begin(), buffer.end());
+			// input closed, nothing more will come
+			std::cout << edit << std::endl;
+			loop.stop();
+			return;
+		}
+		if (handleKey(key))
+		{
+			dispatching = true;
+			loop.post([this, &terminal] { dispatch(terminal); });
+			break;
+		}
+	}
+	std::cout << edit;
 
-				// print prompt. new line should be added from callback function
-				std::cout << _prompt;
+	// a lone ESC, or an escape sequence still coming in
+	if (terminal.partial() && !escape_timer)
+	{
+		escape_timer = loop.addTimer(ESC_TIMEOUT, [this, &terminal] {
+			escape_timer = 0;
+			if (dispatching) return;
+			int key = terminal.expire();
+			edit.clear();
+			if (key != TK_NONE) handleKey(key);
+			std::cout << edit;
+			std::cout.flush();
+		});
+	}
+	std::cout.flush();
+}
 
-				// reset position
-				pos = -1;
-				line_pos = 0;
-				break;
-			default:
-        if (skip_out) {
-          skip_out = 0;
-          break;
-        }
-				std::cout << c;
-				if(line_pos == buffer.size()) {
-					// line position is at the end of the buffer, just append
-					buffer.push_back(c);
-				} else {
-					// line position is not at end. Insert new char
-					buffer.insert(buffer.begin()+line_pos, c);
-					// update screen after current position
-					for (int i = line_pos+1; i < buffer.size(); i++ ) {
-						std::cout << buffer[i];
-					}
-					for (int i = line_pos+1; i < buffer.size(); i++ ) {	
-						std::cout << "\b";
-					}
-				}
-				line_pos++;
-				break;
-		} // end switch
+// Runs the command line completed by the last key
+void tinyConsole::dispatch (tinyTerminal& terminal)
+{
+	// run command
+	//(*callbackFunc)(s.c_str());
+	trigger(s);
+	dispatching = false;
+
+	// check for exit command
+	if(_quit == true) {
+		loop.stop();
+		return;
 	}
 
+	if (history.size() > _max_history) history.pop_back();
+
+	// print prompt. new line should be added from callback function
+	std::cout << _prompt;
+
+	// keys typed while the command ran
+	readKeys(terminal);
+}
+
+// Applies a key to the edit line, collecting the screen update in edit.
+// True when it completes a command line (in s) to be dispatched.
+bool tinyConsole::handleKey (int key)
+{
+	c = key < TK_ESCAPE ? char(key) : 0;
+	if(key < TK_ESCAPE && hotkeys(c)) return false;
+
+	switch (key)
+	{
+		case TK_ESCAPE:
+			edit += "(Esc)";
+			break;
+		case TK_UP:
+			if (!history.size()) break;
+			if (pos == -1)
+			{
+				// store current command
+				unused = buffer.str();
+			}
+
+			pos++;
+			if (pos > (history.size() - 1)) pos = history.size() - 1;
+			replaceLine(history[pos]);
+			break;
+		case TK_DOWN:
+			if (!history.size()) break;
+
+			pos--;
+			if (pos<-1) pos = -1;
+			// past the newest entry, back to what was being typed
+			replaceLine(pos >= 0 ? history[pos] : unused);
+			break;
+		case TK_LEFT:
+			// if there are characters to move left over, do so
+			if (buffer.cursor())
+			{
+				edit += "\b";
+				buffer.moveTo(buffer.cursor() - 1);
+			}
+			break;
+		case TK_RIGHT:
+			// if there are characters to move right over, do so
+			if (buffer.cursor() < buffer.size())
+			{
+				edit += buffer.at(buffer.cursor());
+				buffer.moveTo(buffer.cursor() + 1);
+			}
+			break;
+		case TK_HOME:
+			cursorLeft(edit, buffer.cursor());
+			buffer.moveTo(0);
+			break;
+		case TK_END:
+			buffer.appendTail(edit);
+			buffer.moveTo(buffer.size());
+			break;
+		case TK_DELETE:
+			// delete the character under the cursor; the terminal pulls
+			// the rest of the line in
+			if (buffer.eraseForward())
+			{
+				edit += "\x1b[P";
+			}
+			break;
+		case BACKSPACE:
+			// step back and delete the character there
+			if (buffer.erase())
+			{
+				edit += "\b\x1b[P";
+			}
+			break;
+		case TAB:
+			break;
+			// print history
+			for (int i = 0; i < history.size(); i++) {
+				std::cout << history[i] << std::endl;
+			}
+			break;
+		case NEWLINE:
+			// store in string
+			s = buffer.str();
+
+			// save command to history
+			// trimming of command should be done in callback function
+			if(s.length()) 
+				history.push_front(s);
+
+			edit += "\n";
+
+			// clean buffer
+			buffer.clear();
+
+			// reset position
+			pos = -1;
+			return true;
+		default:
+			if (buffer.cursor() < buffer.size())
+			{
+				// open up a cell for it, shifting the rest of the line right
+				edit += "\x1b[@";
+			}
+			edit += c;
+			buffer.insert(c);
+			break;
+	} // end switch
+	return false;
 }
 
 #if defined(__GNUC__)
@@ -1,4 +1,10 @@
+#include <chrono>
 #include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <stdio.h>
 #include <string.h>
@@ -7,6 +13,7 @@
 #include <conio.h>
 #include <Windows.h>
 #else
+#include <poll.h>
 #include <termios.h>
 #include <unistd.h>
 #endif
@@ -39,9 +46,137 @@
 const char NEWLINE = '\r';
 #else
 const char NEWLINE = '\n';
-int getch();
 #endif
 
+// Keys decoded by tinyTerminal::readKey besides plain characters
+enum {
+	TK_NONE = -2,
+	TK_EOF = -1,
+	TK_ESCAPE = 0x100,
+	TK_UP,
+	TK_DOWN,
+	TK_LEFT,
+	TK_RIGHT,
+	TK_HOME,
+	TK_END,
+	TK_DELETE
+};
+
+/*
+ * Terminal session: puts stdin into raw (non-canonical, no echo) mode for
+ * its lifetime and restores the saved settings when destroyed. Input is
+ * read in bulk into a ring buffer and decoded into keys from there, so an
+ * escape sequence costs no syscalls beyond the read() that brought it in.
+ *
+ * readKey blocks for the next key. An event loop instead calls readInput
+ * when stdin is readable and takes keys with nextKey until it returns
+ * TK_NONE; while partial() holds, expire() after a short timeout turns a
+ * lone ESC into the Escape key.
+ */
+class tinyTerminal {
+public:
+	tinyTerminal();
+	~tinyTerminal();
+	int readKey();
+	bool readInput();
+	int nextKey();
+	bool partial() const;
+	int expire();
+private:
+	tinyTerminal(const tinyTerminal&);
+	tinyTerminal& operator=(const tinyTerminal&);
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32)
+	enum { RING_SIZE = 4096 };
+	bool wait(int timeout);
+
+	bool raw;
+	bool eof;
+	struct termios saved;
+	unsigned char ring[RING_SIZE];
+	size_t head, tail;
+
+	// escape sequence decoder
+	int state;
+	int param;
+	bool first_param;
+#endif
+};
+
+/*
+ * Single-threaded event loop: watches file descriptors for input, fires
+ * one-shot timers and runs tasks posted to it, all on the thread that
+ * calls run. post may be called from any thread, which is how workers
+ * hand their results back.
+ */
+class tinyEventLoop {
+public:
+	typedef std::function<void()> Task;
+
+	tinyEventLoop();
+	~tinyEventLoop();
+	void watch(int fd, const Task& on_readable);
+	void unwatch(int fd);
+	int addTimer(int ms, const Task& on_expiry);
+	void cancelTimer(int id);
+	void post(const Task& task);
+	void run();
+	void stop();
+private:
+	typedef std::chrono::steady_clock clock;
+	struct Watch {
+		int fd;
+		Task on_readable;
+	};
+
+	tinyEventLoop(const tinyEventLoop&);
+	tinyEventLoop& operator=(const tinyEventLoop&);
+	bool runTasks();
+	bool runTimers();
+	int timeout();
+	void wait(int timeout);
+
+	std::vector<Watch> watches;
+	std::map<std::pair<clock::time_point, int>, Task> timers;
+	int next_timer;
+	bool stopped;
+
+	// shared with posting threads
+	std::mutex mutex;
+	std::vector<Task> tasks;
+	std::thread::id owner;
+	bool wake_pending;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+	HANDLE wake_event;
+#else
+	int wake_pipe[2];
+#endif
+};
+
+/*
+ * Edit line as a gap buffer: the text before the cursor sits at the front of
+ * the storage, the text after it at the back, with the free space between.
+ * Typing and deleting at the cursor only moves the gap's edges; moving the
+ * cursor moves just the characters it passes over.
+ */
+class tinyLineBuffer {
+public:
+	tinyLineBuffer();
+	size_t size() const { return data.size() - (gap_end - gap_begin); }
+	size_t cursor() const { return gap_begin; }
+	char at(size_t i) const { return data[i < gap_begin ? i : i + (gap_end - gap_begin)]; }
+	void moveTo(size_t pos);
+	void insert(char c);
+	bool erase();
+	bool eraseForward();
+	void assign(const std::string&);
+	void clear();
+	std::string str() const;
+	void appendTail(std::string&) const;
+private:
+	std::vector<char> data;
+	size_t gap_begin, gap_end;
+};
+
 // getLine modes
 #define M_LINE 0
 #define M_PASSWORD 1
@@ -62,18 +197,25 @@ protected:
 	std::string _prompt;
 
 	int pos;
-	int line_pos;
-	int skip_out;
 	char c;
-	std::string s, unused;
-	std::deque<char> buffer;
+	std::string s, unused, edit;
+	tinyLineBuffer buffer;
 	std::deque<std::string> history;
+	tinyEventLoop loop;
+
+	void replaceLine(const std::string&);
+	bool handleKey(int);
+	void readKeys(tinyTerminal&);
+	void dispatch(tinyTerminal&);
+	int escape_timer;
+	bool dispatching;
 public:
 	tinyConsole();
 	tinyConsole(std::string);
 	void run();
-	void setPrompt(std::string);
-	virtual int trigger(std::string);
+	tinyEventLoop& eventLoop();
+	void setPrompt(const std::string&);
+	virtual int trigger(const std::string&);
 	virtual int hotkeys(char);
 	void pause();
 	void quit();
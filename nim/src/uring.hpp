@@ -0,0 +1,543 @@
+/*
+ * uring.hpp
+ *
+ * io_uring backend for the TCP server. Instead of being told which sockets
+ * are ready and then reading and writing each one with a system call of
+ * its own, the loop queues a receive for every connection and a send for
+ * every pending reply, and hands the kernel all of them, together with the
+ * wait for their results, in one io_uring_enter() per round.
+ *
+ * Received data lands in a ring of buffers registered with the kernel,
+ * which picks one only when data actually arrives, so idle connections
+ * hold none. Replies go out from registered (pinned) send slots, which
+ * saves the kernel mapping the pages on every send.
+ *
+ * There is no C library wrapper for io_uring; the three system calls and
+ * the shared rings are used directly, as <linux/io_uring.h> lays them out.
+ */
+
+#ifndef __nim_uring_hpp__
+#define __nim_uring_hpp__
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <nim/nim_stdtypes.h>
+#include "server.hpp"
+
+namespace nim
+{
+    namespace detail
+    {
+        class UringServer : public Server
+        {
+        public:
+            // submission queue entries; the completion queue gets four times
+            // as many, since completions pile up while a round is handled
+            static const unsigned QUEUE_DEPTH = 1 << 12;
+            // provided receive buffers (a power of two) and their size
+            static const unsigned RECV_BUFFERS = 1 << 10;
+            static const size_t RECV_BUFFER_SIZE = 1 << 12;
+            // registered send slots and their size; a reply that finds none
+            // free is sent from a copy of its own instead
+            static const unsigned SEND_SLOTS = 1 << 8;
+            static const size_t SEND_SLOT_SIZE = 1 << 12;
+
+            // Null when the kernel cannot run this backend (no io_uring, no
+            // provided buffer rings, not allowed to pin the send slots):
+            // EpollServer does then
+            static std::unique_ptr<Server> Create(const SessionFactory& factory)
+            {
+#if defined(__NR_io_uring_setup)
+                std::unique_ptr<UringServer> server(new UringServer(factory));
+                if (server->SetUp())
+                {
+                    // a write cannot say MSG_NOSIGNAL, and a client that goes
+                    // away must not take the process with it
+                    std::signal(SIGPIPE, SIG_IGN);
+                    return std::move(server);
+                }
+#else
+                (void)factory;
+#endif
+                return nullptr;
+            }
+
+            ~UringServer()
+            {
+                // closing the ring cancels whatever is still in flight, so
+                // the buffers can go after it
+                if (ring_fd >= 0) { ::close(ring_fd); }
+                Unmap(sq_ring, sq_ring_size);
+                if (cq_ring != sq_ring) { Unmap(cq_ring, cq_ring_size); }
+                Unmap(sqes, sqes_size);
+                Unmap(buffer_ring, RECV_BUFFERS * sizeof(io_uring_buf));
+                Unmap(recv_buffers, size_t(RECV_BUFFERS) * RECV_BUFFER_SIZE);
+                Unmap(send_slots, size_t(SEND_SLOTS) * SEND_SLOT_SIZE);
+            }
+
+            virtual const char* Backend() const override
+            {
+                return "io_uring";
+            }
+
+            virtual void Run() override
+            {
+                // a ring set up for a single issuer belongs to the thread
+                // that enables it
+                if (disabled && Register(IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0) { return; }
+                disabled = false;
+                Accept();
+                Wait();
+                while (!stopping)
+                {
+                    if (Enter(1) < 0 && errno != EINTR && errno != EBUSY) { return; }
+                    Reap();
+                    // connections that found every receive buffer taken try
+                    // again now that the round has given them back
+                    starved.swap(retry);
+                    for (auto fd : retry)
+                    {
+                        if (auto connection = Find(fd)) { Pump(*connection); }
+                    }
+                    retry.clear();
+                }
+            }
+
+        protected:
+            virtual bool StartListening() override
+            {
+                return true;
+            }
+
+        private:
+            enum Op : uint64
+            {
+                OP_ACCEPT,
+                OP_RECV,
+                OP_SEND,
+                OP_WAKE
+            };
+
+            static const uint32 NO_SLOT = ~uint32(0);
+
+            // What a connection has in flight. Its socket stays open until
+            // nothing is, so a late completion never meets a reused
+            // descriptor.
+            struct Flight
+            {
+                bool Receiving = false;
+                bool Sending = false;
+                uint32 Slot = NO_SLOT;  // send slot in use, NO_SLOT for Spill
+                // the send in flight when no slot was free. On the heap, so
+                // it stays put while flights grows and moves the records;
+                // a short string's bytes would move with them.
+                std::unique_ptr<char[]> Spill;
+                size_t SpillCapacity = 0;
+            };
+
+            explicit UringServer(const SessionFactory& factory) : Server(factory) {}
+
+            static int Setup(unsigned entries, io_uring_params* params)
+            {
+                return int(::syscall(__NR_io_uring_setup, entries, params));
+            }
+
+            int Enter(unsigned wait)
+            {
+                auto submit = sq_tail - Load(sq_head);
+                return int(::syscall(__NR_io_uring_enter, ring_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0));
+            }
+
+            int Register(unsigned opcode, const void* arg, unsigned count)
+            {
+                return int(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, count));
+            }
+
+            // the rings are shared with the kernel: positions it writes are
+            // read with acquire, positions it reads are written with release
+            static uint32 Load(const uint32* p)
+            {
+                return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+            }
+
+            template <typename T>
+            static void Store(T* p, T value)
+            {
+                __atomic_store_n(p, value, __ATOMIC_RELEASE);
+            }
+
+            static void* Map(size_t size, int fd = -1, off_t offset = 0)
+            {
+                auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE, fd, offset);
+                return p == MAP_FAILED ? nullptr : p;
+            }
+
+            static void Unmap(void* p, size_t size)
+            {
+                if (p) { ::munmap(p, size); }
+            }
+
+            bool SetUp()
+            {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof params);
+                // one thread submits and reaps, so the kernel can leave the
+                // completion work to when it waits instead of interrupting it
+                params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+                params.cq_entries = 4 * QUEUE_DEPTH;
+                ring_fd = Setup(QUEUE_DEPTH, &params);
+                if (ring_fd < 0 && errno == EINVAL)
+                {
+                    // older kernels: no single-issuer rings
+                    std::memset(&params, 0, sizeof params);
+                    params.flags = IORING_SETUP_CQSIZE;
+                    params.cq_entries = 4 * QUEUE_DEPTH;
+                    ring_fd = Setup(QUEUE_DEPTH, &params);
+                }
+                if (ring_fd < 0) { return false; }
+                disabled = (params.flags & IORING_SETUP_R_DISABLED) != 0;
+
+                sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32);
+                cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                if (params.features & IORING_FEAT_SINGLE_MMAP)
+                {
+                    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+                }
+                sq_ring = static_cast<char*>(Map(sq_ring_size, ring_fd, IORING_OFF_SQ_RING));
+                cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring : static_cast<char*>(Map(cq_ring_size, ring_fd, IORING_OFF_CQ_RING));
+                sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+                sqes = static_cast<io_uring_sqe*>(Map(sqes_size, ring_fd, IORING_OFF_SQES));
+                if (!sq_ring || !cq_ring || !sqes) { return false; }
+
+                sq_head = reinterpret_cast<uint32*>(sq_ring + params.sq_off.head);
+                sq_tail_shared = reinterpret_cast<uint32*>(sq_ring + params.sq_off.tail);
+                sq_mask = *reinterpret_cast<uint32*>(sq_ring + params.sq_off.ring_mask);
+                sq_entries = params.sq_entries;
+                sq_array = reinterpret_cast<uint32*>(sq_ring + params.sq_off.array);
+                sq_tail = *sq_tail_shared;
+                cq_head = reinterpret_cast<uint32*>(cq_ring + params.cq_off.head);
+                cq_tail = reinterpret_cast<uint32*>(cq_ring + params.cq_off.tail);
+                cq_mask = *reinterpret_cast<uint32*>(cq_ring + params.cq_off.ring_mask);
+                cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+
+                // receive buffers, handed to the kernel as buffer group 0
+                buffer_ring = static_cast<io_uring_buf*>(Map(RECV_BUFFERS * sizeof(io_uring_buf)));
+                recv_buffers = static_cast<char*>(Map(size_t(RECV_BUFFERS) * RECV_BUFFER_SIZE));
+                if (!buffer_ring || !recv_buffers) { return false; }
+                io_uring_buf_reg reg;
+                std::memset(&reg, 0, sizeof reg);
+                reg.ring_addr = uint64(uintptr_t(buffer_ring));
+                reg.ring_entries = RECV_BUFFERS;
+                reg.bgid = 0;
+                if (Register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) { return false; }
+                for (uint16 id = 0; id < RECV_BUFFERS; ++id)
+                {
+                    GiveBack(id);
+                }
+
+                // send slots, one registered buffer that sends point into
+                send_slots = static_cast<char*>(Map(size_t(SEND_SLOTS) * SEND_SLOT_SIZE));
+                if (!send_slots) { return false; }
+                struct iovec slots;
+                slots.iov_base = send_slots;
+                slots.iov_len = size_t(SEND_SLOTS) * SEND_SLOT_SIZE;
+                if (Register(IORING_REGISTER_BUFFERS, &slots, 1) < 0) { return false; }
+                for (auto slot = SEND_SLOTS; slot-- > 0;)
+                {
+                    free_slots.push_back(slot);
+                }
+                return true;
+            }
+
+            // Next free submission entry, cleared. When the queue is full,
+            // what it holds goes to the kernel first.
+            io_uring_sqe& Submission(Op op, uint32 fd, uint32 slot = NO_SLOT)
+            {
+                while (sq_tail - Load(sq_head) >= sq_entries)
+                {
+                    Store(sq_tail_shared, sq_tail);
+                    if (Enter(0) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) { break; }
+                }
+                auto index = sq_tail & sq_mask;
+                auto& sqe = sqes[index];
+                std::memset(&sqe, 0, sizeof sqe);
+                // the operation, the descriptor and the send slot plus one,
+                // so that NO_SLOT comes back out of the top 24 bits
+                sqe.user_data = op | (uint64(fd) << 8) | (uint64(slot + 1) << 40);
+                sq_array[index] = index;
+                Store(sq_tail_shared, ++sq_tail);
+                return sqe;
+            }
+
+            // Returns a receive buffer to the kernel
+            void GiveBack(uint16 id)
+            {
+                auto& entry = buffer_ring[buffer_tail & (RECV_BUFFERS - 1)];
+                entry.addr = uint64(uintptr_t(recv_buffers + size_t(id) * RECV_BUFFER_SIZE));
+                entry.len = uint32(RECV_BUFFER_SIZE);
+                entry.bid = id;
+                // the ring's tail overlays the first entry's last field
+                Store(&reinterpret_cast<io_uring_buf_ring*>(buffer_ring)->tail, ++buffer_tail);
+            }
+
+            Connection* Find(uint32 fd)
+            {
+                return fd < connections.size() ? connections[fd].get() : nullptr;
+            }
+
+            void Accept()
+            {
+                auto& sqe = Submission(OP_ACCEPT, uint32(listen_fd));
+                sqe.opcode = IORING_OP_ACCEPT;
+                sqe.fd = listen_fd;
+                sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                accepting = true;
+            }
+
+            // Reads wake_fd, which completes once Stop has been called
+            void Wait()
+            {
+                auto& sqe = Submission(OP_WAKE, uint32(wake_fd));
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = wake_fd;
+                sqe.addr = uint64(uintptr_t(&wake_count));
+                sqe.len = uint32(sizeof wake_count);
+            }
+
+            // Handles every completion the kernel has posted
+            void Reap()
+            {
+                auto head = *cq_head;
+                auto tail = Load(cq_tail);
+                while (head != tail)
+                {
+                    auto cqe = cqes[head & cq_mask];
+                    Store(cq_head, ++head);
+                    auto fd = uint32(cqe.user_data >> 8);
+                    switch (Op(cqe.user_data & 0xff))
+                    {
+                        case OP_ACCEPT:
+                            Accepted(cqe.res);
+                            break;
+                        case OP_RECV:
+                            Received(fd, cqe.res, cqe.flags);
+                            break;
+                        case OP_SEND:
+                            Sent(fd, uint32(cqe.user_data >> 40) - 1, cqe.res);
+                            break;
+                        case OP_WAKE:
+                            stopping = true;
+                            break;
+                    }
+                    tail = Load(cq_tail);
+                }
+            }
+
+            void Accepted(int fd)
+            {
+                accepting = false;
+                if (fd >= 0)
+                {
+                    if (size_t(fd) >= flights.size()) { flights.resize(size_t(fd) + 1); }
+                    Pump(Open(fd));
+                }
+                if (fd >= 0 || fd == -EINTR || fd == -ECONNABORTED || fd == -EAGAIN)
+                {
+                    Accept();
+                }
+                // out of descriptors or memory: accepting resumes when a
+                // connection closes
+            }
+
+            void Received(uint32 fd, int count, uint32 flags)
+            {
+                auto connection = Find(fd);
+                if (flags & IORING_CQE_F_BUFFER)
+                {
+                    auto id = uint16(flags >> IORING_CQE_BUFFER_SHIFT);
+                    if (connection && count > 0 && !connection->Closing)
+                    {
+                        connection->In.append(recv_buffers + size_t(id) * RECV_BUFFER_SIZE, size_t(count));
+                    }
+                    GiveBack(id);
+                }
+                if (!connection) { return; }
+                flights[fd].Receiving = false;
+                if (count == -ENOBUFS)
+                {
+                    starved.push_back(fd);
+                    return;
+                }
+                if (count <= 0)
+                {
+                    // closed or reset: no more commands
+                    connection->Eof = true;
+                }
+                Pump(*connection);
+            }
+
+            void Sent(uint32 fd, uint32 slot, int count)
+            {
+                if (slot != NO_SLOT) { free_slots.push_back(slot); }
+                auto connection = Find(fd);
+                if (!connection) { return; }
+                auto& flight = flights[fd];
+                flight.Sending = false;
+                flight.Slot = NO_SLOT;
+                if (count > 0)
+                {
+                    connection->OutBegin += size_t(count);
+                    if (connection->OutBegin == connection->Out.size())
+                    {
+                        connection->Out.clear();
+                        connection->OutBegin = 0;
+                    }
+                }
+                else if (count != -EINTR && count != -EAGAIN)
+                {
+                    // the replies cannot be delivered
+                    connection->Eof = connection->Closing = true;
+                    connection->Out.clear();
+                    connection->OutBegin = 0;
+                }
+                Pump(*connection);
+            }
+
+            // Runs what has come in, and queues the send and the receive the
+            // connection needs next, or closes it once it is done
+            void Pump(Connection& connection)
+            {
+                auto& flight = flights[connection.Fd];
+                RunLines(connection);
+                auto pending = connection.Out.size() - connection.OutBegin;
+                if (!flight.Sending && pending > 0)
+                {
+                    Send(connection, flight);
+                }
+                auto done = connection.Closing || connection.Eof;
+                if (!done && !flight.Receiving && pending < MAX_PENDING_OUTPUT)
+                {
+                    Receive(connection, flight);
+                }
+                if (done && !flight.Sending && pending == 0)
+                {
+                    if (flight.Receiving)
+                    {
+                        // the receive completes, empty, and brings us back
+                        ::shutdown(connection.Fd, SHUT_RDWR);
+                    }
+                    else
+                    {
+                        Close(connection);
+                        if (flight.SpillCapacity > READ_SIZE)
+                        {
+                            flight.Spill.reset();
+                            flight.SpillCapacity = 0;
+                        }
+                        if (!accepting) { Accept(); }
+                    }
+                }
+            }
+
+            void Receive(Connection& connection, Flight& flight)
+            {
+                auto& sqe = Submission(OP_RECV, uint32(connection.Fd));
+                sqe.opcode = IORING_OP_RECV;
+                sqe.fd = connection.Fd;
+                sqe.len = uint32(RECV_BUFFER_SIZE);
+                sqe.flags = IOSQE_BUFFER_SELECT;
+                sqe.buf_group = 0;
+                flight.Receiving = true;
+            }
+
+            // Queues a send of the start of the pending output, from a send
+            // slot when one is free
+            void Send(Connection& connection, Flight& flight)
+            {
+                auto data = connection.Out.data() + connection.OutBegin;
+                auto size = connection.Out.size() - connection.OutBegin;
+                if (!free_slots.empty())
+                {
+                    auto slot = free_slots.back();
+                    free_slots.pop_back();
+                    size = std::min(size, size_t(SEND_SLOT_SIZE));
+                    auto buffer = send_slots + size_t(slot) * SEND_SLOT_SIZE;
+                    std::memcpy(buffer, data, size);
+                    auto& sqe = Submission(OP_SEND, uint32(connection.Fd), slot);
+                    sqe.opcode = IORING_OP_WRITE_FIXED;
+                    sqe.fd = connection.Fd;
+                    sqe.addr = uint64(uintptr_t(buffer));
+                    sqe.len = uint32(size);
+                    sqe.buf_index = 0;
+                    flight.Slot = slot;
+                }
+                else
+                {
+                    // Out may grow (and move) while this is in flight
+                    size = std::min(size, size_t(MAX_PENDING_OUTPUT));
+                    if (flight.SpillCapacity < size)
+                    {
+                        flight.Spill.reset(new char[size]);
+                        flight.SpillCapacity = size;
+                    }
+                    std::memcpy(flight.Spill.get(), data, size);
+                    auto& sqe = Submission(OP_SEND, uint32(connection.Fd), NO_SLOT);
+                    sqe.opcode = IORING_OP_SEND;
+                    sqe.fd = connection.Fd;
+                    sqe.addr = uint64(uintptr_t(flight.Spill.get()));
+                    sqe.len = uint32(size);
+                    sqe.msg_flags = MSG_NOSIGNAL;
+                }
+                flight.Sending = true;
+            }
+
+            int ring_fd = -1;
+            bool disabled = false;
+            bool accepting = false;
+            bool stopping = false;
+            uint64 wake_count = 0;
+            char* sq_ring = nullptr;
+            char* cq_ring = nullptr;
+            size_t sq_ring_size = 0;
+            size_t cq_ring_size = 0;
+            io_uring_sqe* sqes = nullptr;
+            size_t sqes_size = 0;
+            uint32* sq_head = nullptr;
+            uint32* sq_tail_shared = nullptr;
+            uint32* sq_array = nullptr;
+            uint32 sq_mask = 0;
+            uint32 sq_entries = 0;
+            uint32 sq_tail = 0;         // ours, published to sq_tail_shared
+            uint32* cq_head = nullptr;
+            uint32* cq_tail = nullptr;
+            uint32 cq_mask = 0;
+            io_uring_cqe* cqes = nullptr;
+            io_uring_buf* buffer_ring = nullptr;
+            uint16 buffer_tail = 0;
+            char* recv_buffers = nullptr;
+            char* send_slots = nullptr;
+            std::vector<uint32> free_slots;
+            // by descriptor, like the connections
+            std::vector<Flight> flights;
+            std::vector<uint32> starved;
+            std::vector<uint32> retry;
+        };
+    }
+}
+
+#endif /* __linux__ */
+
+#endif /* __nim_uring_hpp__ */
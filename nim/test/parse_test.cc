@@ -0,0 +1,343 @@
+/*
+ * nim_parse_test: checks parse.hpp's integer and float parsers against the
+ * C library (strtoll/strtoull, strtod/strtof), which are exact, on
+ * boundaries and on a few hundred thousand generated inputs.
+ *
+ *   nim_parse_test
+ *
+ * Prints every mismatch and exits non-zero if there was one.
+ */
+
+#include "../src/parse.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <nim/Random.h>
+
+namespace nim
+{
+    namespace test
+    {
+        using namespace numerics;
+
+        static int g_failures = 0;
+
+        #define CHECK(condition, ...) \
+            do \
+            { \
+                if (!(condition)) \
+                { \
+                    ++g_failures; \
+                    std::printf("%s:%d: failed: %s: ", __FILE__, __LINE__, #condition); \
+                    std::printf(__VA_ARGS__); \
+                    std::printf("\n"); \
+                } \
+            } while (false)
+
+        template <typename T>
+        static parse_errc Parse(const std::string& text, T& value, unsigned base = 10, size_t* used = nullptr)
+        {
+            auto result = from_chars(text.data(), text.data() + text.size(), value, base);
+            if (used) { *used = size_t(result.ptr - text.data()); }
+            return result.ec;
+        }
+
+        template <typename T>
+        static parse_errc ParseFp(const std::string& text, T& value, size_t* used = nullptr)
+        {
+            auto result = from_chars(text.data(), text.data() + text.size(), value);
+            if (used) { *used = size_t(result.ptr - text.data()); }
+            return result.ec;
+        }
+
+        // value in base, lowercase digits, with a '-' if negative
+        static std::string Format(uint64 magnitude, bool negative, unsigned base)
+        {
+            static const char DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+            std::string digits;
+            do
+            {
+                digits.insert(digits.begin(), DIGITS[magnitude % base]);
+                magnitude /= base;
+            } while (magnitude);
+            return negative ? "-" + digits : digits;
+        }
+
+        // A decimal number's digits plus one, the sign left alone
+        static std::string Increment(std::string text)
+        {
+            auto i = text.size();
+            while (i-- > 0 && text[i] == '9')
+            {
+                text[i] = '0';
+            }
+            if (i == size_t(-1) || text[i] == '-')
+            {
+                text.insert(i + 1, "1");
+            }
+            else
+            {
+                ++text[i];
+            }
+            return text;
+        }
+
+        // The decimal digits of 5^power
+        static std::string PowerOf5(unsigned power)
+        {
+            std::string digits = "1";
+            for (unsigned i = 0; i < power; ++i)
+            {
+                auto carry = 0;
+                for (auto j = digits.size(); j-- > 0;)
+                {
+                    auto product = (digits[j] - '0') * 5 + carry;
+                    digits[j] = char('0' + product % 10);
+                    carry = product / 10;
+                }
+                if (carry) { digits.insert(digits.begin(), char('0' + carry)); }
+            }
+            return digits;
+        }
+
+        template <typename T>
+        static void CheckLimits(const char* type)
+        {
+            auto max = std::to_string(std::numeric_limits<T>::max());
+            auto min = std::to_string(std::numeric_limits<T>::min());
+            T value = 0;
+            CHECK(Parse(max, value) == parse_errc::ok && value == std::numeric_limits<T>::max(), "%s max %s", type, max.c_str());
+            CHECK(Parse(min, value) == parse_errc::ok && value == std::numeric_limits<T>::min(), "%s min %s", type, min.c_str());
+
+            // one past either end, and far past, fail without touching value
+            auto above = Increment(max);
+            value = T(7);
+            size_t used;
+            CHECK(Parse(above, value, 10, &used) == parse_errc::result_out_of_range && value == T(7) && used == above.size(),
+                "%s max + 1 %s", type, above.c_str());
+            CHECK(Parse(std::string("99999999999999999999999999"), value) == parse_errc::result_out_of_range && value == T(7),
+                "%s far above", type);
+            if (std::is_signed<T>::value)
+            {
+                auto below = Increment(min);
+                CHECK(Parse(below, value) == parse_errc::result_out_of_range && value == T(7), "%s min - 1 %s", type, below.c_str());
+            }
+            else
+            {
+                CHECK(Parse(std::string("-1"), value) == parse_errc::invalid_argument && value == T(7), "%s -1", type);
+            }
+        }
+
+        static void TestIntegerSyntax()
+        {
+            int32 value = 5;
+            size_t used;
+            CHECK(Parse(std::string(""), value, 10, &used) == parse_errc::invalid_argument && used == 0 && value == 5, "empty");
+            CHECK(Parse(std::string("-"), value, 10, &used) == parse_errc::invalid_argument && used == 0, "sign only");
+            CHECK(Parse(std::string("x1"), value, 10, &used) == parse_errc::invalid_argument && used == 0, "no digits");
+            CHECK(Parse(std::string("+42"), value) == parse_errc::ok && value == 42, "plus sign");
+            CHECK(Parse(std::string("-0"), value) == parse_errc::ok && value == 0, "negative zero");
+            CHECK(Parse(std::string("123abc"), value, 10, &used) == parse_errc::ok && value == 123 && used == 3, "stops at a non-digit");
+            CHECK(Parse(std::string("12"), value, 1) == parse_errc::invalid_argument, "base 1");
+            CHECK(Parse(std::string("12"), value, 37) == parse_errc::invalid_argument, "base 37");
+            CHECK(Parse(std::string("19"), value, 9, &used) == parse_errc::ok && value == 1 && used == 1, "digit outside the base");
+            CHECK(Parse(std::string("zZ"), value, 36) == parse_errc::ok && value == 35 * 36 + 35, "letters of either case");
+
+            // the SWAR path takes 8 digits at a time: runs of every length
+            // around its blocks, and leading zeros that fill whole blocks
+            std::string digits;
+            for (auto length = 1; length <= 19; ++length)
+            {
+                digits += char('0' + length % 10);
+                int64 parsed = 0;
+                CHECK(Parse(digits, parsed) == parse_errc::ok && parsed == std::strtoll(digits.c_str(), nullptr, 10), "%s", digits.c_str());
+            }
+            uint64 big = 0;
+            auto zeros = std::string(40, '0') + "18446744073709551615";
+            CHECK(Parse(zeros, big) == parse_errc::ok && big == std::numeric_limits<uint64>::max(), "leading zeros");
+
+            CHECK(parse_hex<int32>("-0x7fFFffFF", &value) && value == -0x7fffffff, "parse_hex");
+            CHECK(!parse_hex<int32>("0x80000000", &value), "parse_hex overflow");
+            CHECK(parse_bin<int32>("0b101", &value) && value == 5, "parse_bin");
+            CHECK(!parse_integral<int32>("12 ", &value), "parse_integral trailing space");
+        }
+
+        // Random values, in every base, against strtoull/strtoll
+        static void TestBases(Random& random)
+        {
+            for (unsigned base = 2; base <= 36; ++base)
+            {
+                for (auto i = 0; i < 2000; ++i)
+                {
+                    // every magnitude, not just huge ones
+                    auto magnitude = random.Next() >> random.Below(64);
+                    auto text = Format(magnitude, false, base);
+                    uint64 unsigned_value = 0;
+                    CHECK(Parse(text, unsigned_value, base) == parse_errc::ok && unsigned_value == std::strtoull(text.c_str(), nullptr, int(base)),
+                        "base %u: %s", base, text.c_str());
+
+                    auto negative = (i & 1) != 0;
+                    auto signed_text = Format(magnitude >> 1, negative, base);
+                    int64 signed_value = 0;
+                    CHECK(Parse(signed_text, signed_value, base) == parse_errc::ok && signed_value == std::strtoll(signed_text.c_str(), nullptr, int(base)),
+                        "base %u: %s", base, signed_text.c_str());
+                }
+
+                // one past uint64 in this base
+                auto max = Format(std::numeric_limits<uint64>::max(), false, base);
+                uint64 value = 0;
+                CHECK(Parse(max, value, base) == parse_errc::ok && value == std::numeric_limits<uint64>::max(), "base %u max", base);
+                CHECK(Parse(max + "0", value, base) == parse_errc::result_out_of_range, "base %u max * base", base);
+            }
+        }
+
+        template <typename T>
+        static bool SameBits(T a, T b)
+        {
+            return std::memcmp(&a, &b, sizeof a) == 0;
+        }
+
+        static void CheckDouble(const std::string& text)
+        {
+            errno = 0;
+            auto expected = std::strtod(text.c_str(), nullptr);
+            auto overflow = (errno == ERANGE && std::isinf(expected));
+            double value = 0;
+            auto ec = ParseFp(text, value);
+            if (overflow)
+            {
+                CHECK(ec == parse_errc::result_out_of_range, "%s overflows", text.c_str());
+            }
+            else
+            {
+                CHECK(ec == parse_errc::ok && SameBits(value, expected), "%s: %.17g, expected %.17g", text.c_str(), value, expected);
+            }
+        }
+
+        static void CheckFloat(const std::string& text)
+        {
+            errno = 0;
+            auto expected = std::strtof(text.c_str(), nullptr);
+            auto overflow = (errno == ERANGE && std::isinf(expected));
+            float value = 0;
+            auto ec = ParseFp(text, value);
+            if (overflow)
+            {
+                CHECK(ec == parse_errc::result_out_of_range, "%s overflows float", text.c_str());
+            }
+            else
+            {
+                CHECK(ec == parse_errc::ok && SameBits(value, expected), "%s: %.9g, expected %.9g", text.c_str(), double(value), double(expected));
+            }
+        }
+
+        static void TestFloatCases()
+        {
+            const char* cases[] = {
+                "0", "-0", "0.0", "1", "-1", "1.5", ".5", "5.", "1e0", "1E+2", "1e-2", "123.456e7",
+                // boundaries: max, past max, min normal, subnormals, past min
+                "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308", "1e309",
+                "2.2250738585072014e-308", "2.2250738585072011e-308", "4.9406564584124654e-324",
+                "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+                // halfway between two doubles: ties go to even
+                "9007199254740993", "9007199254740995", "9007199254740993.0000000000000001",
+                "2.00000000000000011102230246251565404236316680908203125",
+                "2.00000000000000011102230246251565404236316680908203124",
+                "2.00000000000000011102230246251565404236316680908203126",
+                // 17 and more significant digits
+                "2.2250738585072012e-308", "0.1000000000000000055511151231257827021181583404541015625",
+                "123456789012345678901234567890", "3.14159265358979323846264338327950288419716939937510",
+                // the exponent on its own can be huge either way
+                "0.000000000000000000000000000000000000000000000000001e51", "1e-99999", "1e99999"
+            };
+            for (auto text : cases)
+            {
+                CheckDouble(text);
+                CheckFloat(text);
+            }
+
+            // exactly halfway between 0 and the smallest subnormal, 2^-1075,
+            // spelled out in full (it rounds to even, 0), then nudged above
+            // it in the last of its 750-odd digits: only the exact path can
+            // tell the two apart
+            auto halfway = PowerOf5(1075);
+            CheckDouble(halfway + "e-1075");
+            CheckDouble(halfway + "1e-1076");
+            CheckFloat(halfway + "e-1075");
+            std::string long_halfway = "9007199254740993." + std::string(800, '0');
+            CheckDouble(long_halfway);
+            CheckDouble(long_halfway + "1");
+
+            double value = 3;
+            size_t used;
+            CHECK(ParseFp(std::string("e5"), value, &used) == parse_errc::invalid_argument && used == 0 && value == 3, "exponent only");
+            CHECK(ParseFp(std::string("."), value, &used) == parse_errc::invalid_argument && used == 0, "point only");
+            CHECK(ParseFp(std::string("1e"), value, &used) == parse_errc::ok && value == 1 && used == 1, "exponent without digits");
+            CHECK(ParseFp(std::string("2.5x"), value, &used) == parse_errc::ok && value == 2.5 && used == 3, "stops at a non-digit");
+        }
+
+        // Random decimal strings of up to 25 digits and any exponent, and
+        // random bit patterns printed with 17 digits, which must come back
+        static void TestFloatRandom(Random& random)
+        {
+            char text[64];
+            for (auto i = 0; i < 200000; ++i)
+            {
+                std::string digits;
+                auto length = 1 + random.Below(25);
+                for (uint32 j = 0; j < length; ++j)
+                {
+                    digits += char('0' + random.Below(10));
+                }
+                auto point = random.Below(length + 1);
+                digits.insert(point, ".");
+                auto exponent = int(random.Below(700)) - 350;
+                std::snprintf(text, sizeof text, "e%d", exponent);
+                CheckDouble(digits + text);
+                CheckFloat(digits + text);
+
+                uint64 bits = random.Next();
+                double original;
+                std::memcpy(&original, &bits, sizeof original);
+                if (std::isfinite(original))
+                {
+                    std::snprintf(text, sizeof text, "%.17g", original);
+                    double parsed = 0;
+                    CHECK(ParseFp(std::string(text), parsed) == parse_errc::ok && SameBits(parsed, original), "round trip %s", text);
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    using namespace nim;
+    using namespace nim::test;
+
+    Random random(2014);
+    CheckLimits<int8>("int8");
+    CheckLimits<uint8>("uint8");
+    CheckLimits<int16>("int16");
+    CheckLimits<uint16>("uint16");
+    CheckLimits<int32>("int32");
+    CheckLimits<uint32>("uint32");
+    CheckLimits<int64>("int64");
+    CheckLimits<uint64>("uint64");
+    TestIntegerSyntax();
+    TestBases(random);
+    TestFloatCases();
+    TestFloatRandom(random);
+
+    if (g_failures)
+    {
+        std::printf("%d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}